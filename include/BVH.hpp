@@ -0,0 +1,45 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace RD3D {
+    /**
+     * A node of a bounding volume hierarchy. Leaves (count > 0) hold count triangles starting at first,
+     * interior nodes (count == 0) have their two children stored next to each other starting at first.
+     */
+    struct BVHNode {
+        glm::vec3 min;
+        int first;
+        glm::vec3 max;
+        int count;
+    };
+
+    /**
+     * A bounding volume hierarchy over the triangles of a mesh, built with the surface area heuristic.
+     * Used to find which parts of space a mesh passes through and to test points for being inside of it.
+     */
+    class BVH {
+    public:
+        BVH(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+        BVH(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, std::vector<BVHNode> nodes, std::vector<unsigned int> triangle_order);
+
+        static bool is_valid(const std::vector<BVHNode>& nodes, const std::vector<unsigned int>& triangle_order, size_t triangle_count);
+
+        const std::vector<BVHNode>& get_nodes() const;
+        const std::vector<unsigned int>& get_triangle_order() const;
+
+        bool overlaps_box(glm::vec3 lo, glm::vec3 hi) const;
+        void x_ray_crossings(float y, float z, float x_from, std::vector<float>& crossings) const;
+        bool is_inside(glm::vec3 p) const;
+    private:
+        std::vector<BVHNode> nodes;
+        std::vector<glm::vec3> triangles; // Three corners per triangle, in leaf order
+        std::vector<unsigned int> triangle_order; // Index of the mesh triangle at each position of the leaf order
+
+        void build(int node, int first, int count, std::vector<int>& refs, const std::vector<glm::vec3>& bounds_min, const std::vector<glm::vec3>& bounds_max, const std::vector<glm::vec3>& centroids, int depth);
+        int allocate_nodes(int count);
+        void gather_triangles(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+        int node_count = 0;
+    };
+}
@@ -4,17 +4,31 @@
 #include "Shader.hpp"
 #include "Mesh.hpp"
 #include "OrbitalCamera.hpp"
+#include "SignedDistanceField.hpp"
+#include "BVH.hpp"
+#include "CSG.hpp"
 
 #include <vector>
 #include <string>
 #include <memory>
+#include <functional>
 
 namespace RD3D {
     class Simulator;
 
+    enum class BrickState {
+        Unknown = 0,
+        Empty,
+        Full,
+        Surface
+    };
+
     /**
      * Manages the transformation and drawing of boundary meshes and the voxelization
-     * of said meshes into boundary values stored the grid.
+     * of said meshes into boundary values stored the grid. Voxelization samples a signed distance
+     * field of the mesh and tests cells for being inside of it against a BVH, brick by brick, so it can
+     * be redone incrementally while the mesh's transform is being changed. Boundaries can also be built
+     * without a mesh from a tree of implicit primitives.
      */
     class Boundary {
     public:
@@ -26,6 +40,7 @@ namespace RD3D {
         void clear_boundary();
         void thicken_boundary();
         void invert_boundary();
+        void apply_primitives();
 
         void draw_boundary_mesh(OrbitalCamera& camera);
         void draw_grid_boundary_mesh(OrbitalCamera& camera);
@@ -37,14 +52,29 @@ namespace RD3D {
         Shader boundary_shader;
         Mesh grid_boundary_mesh;
         std::unique_ptr<Mesh> boundary_mesh;
+        std::unique_ptr<SignedDistanceField> boundary_sdf;
+        std::unique_ptr<BVH> boundary_bvh;
+        std::vector<BrickState> brick_states;
+        static constexpr int sdf_resolution = 128;
+        bool boundary_voxelized = false;
+        bool fill_interior = false;
 
         glm::vec3 boundary_offset = glm::vec3(0.0f, 0.0f, 0.0f);
         float boundary_scale = 1.0f;
         std::string boundary_obj_path;
 
+        std::vector<CSGPrimitive> csg_primitives;
+        bool csg_live = true;
+
         float grid_cube_opacity = 0.1f;
         float boundary_mesh_opacity = 0.3f;
 
+        void build_boundary_structures();
+        void update_boundary_bricks();
+        std::unique_ptr<CSGNode> build_csg_tree();
+        void draw_primitives_gui();
+        void fill_boundary_bricks(const std::function<bool(glm::ivec3, glm::ivec3, float*)>& evaluate_brick);
+
         friend class Simulator;
     };
 }
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <memory>
+
+namespace RD3D {
+    enum class CSGType {
+        Sphere = 0,
+        Box,
+        Cylinder,
+        Torus,
+        Gyroid,
+        Plane,
+        Union,
+        Intersection,
+        Difference
+    };
+
+    /**
+     * A primitive of the boundary's CSG tree along with the operation that combines it with the primitives before it.
+     */
+    struct CSGPrimitive {
+        CSGType type = CSGType::Sphere;
+        CSGType operation = CSGType::Union;
+        glm::vec3 center = glm::vec3(0.0f);
+        glm::vec3 size = glm::vec3(0.25f);
+    };
+
+    /**
+     * A node of a constructive solid geometry tree. Leaves are implicit primitives given by a signed distance
+     * (negative inside), and inner nodes combine the distances of their two children.
+     * 
+     * The meaning of size depends on the primitive:
+     * Sphere - x is the radius
+     * Box - half of the extents along each axis
+     * Cylinder - x is the radius, y is half of the height along the y axis
+     * Torus - x is the major radius, y is the minor radius, lying in the xz plane
+     * Gyroid - x is the period, clamped to a small positive minimum, y is the wall thickness
+     * Plane - the normal, pointing away from the inside, or +Y if it is zero
+     */
+    struct CSGNode {
+        CSGType type = CSGType::Sphere;
+        glm::vec3 center = glm::vec3(0.0f);
+        glm::vec3 size = glm::vec3(0.25f);
+        std::unique_ptr<CSGNode> left;
+        std::unique_ptr<CSGNode> right;
+
+        float evaluate(glm::vec3 p) const;
+        void evaluate_row(float x0, float dx, float y, float z, int n, float* out) const;
+        float lipschitz_bound() const;
+    };
+}
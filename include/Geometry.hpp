@@ -0,0 +1,8 @@
+#pragma once
+#include <glm/glm.hpp>
+
+namespace RD3D {
+    glm::vec3 closest_point_on_triangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c);
+    float point_triangle_distance(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c);
+    bool point_in_triangle_2d(double x0, double y0, double x1, double y1, double x2, double y2, double x3, double y3, double& a, double& b, double& c);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+namespace RD3D {
+    /**
+     * A read only view of a file's contents mapped into memory.
+     */
+    class MappedFile {
+    public:
+        MappedFile(const std::string& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool is_open() const;
+        const char* data() const;
+        size_t size() const;
+    private:
+        const char* contents = nullptr;
+        size_t length = 0;
+        bool open = false;
+
+#ifdef _WIN32
+        void* file_handle = nullptr;
+        void* mapping_handle = nullptr;
+#else
+        int file_descriptor = -1;
+#endif
+    };
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace RD3D {
+    /**
+     * A utility struct for use in the Marching Cubes Shader to write vertices from a
+     * compute shader to a vertex array.
+     */
+    struct MarchingCubeVertex {
+        alignas(8) glm::vec3 pos;
+        alignas(8) glm::vec3 normal;
+    };
+
+    /**
+     * An indexed triangle mesh produced by Marching Cubes, where every vertex is shared
+     * by all of the triangles that touch its grid edge.
+     */
+    struct MarchingCubesMesh {
+        std::vector<MarchingCubeVertex> vertices;
+        std::vector<unsigned int> indices;
+    };
+
+    struct WeldResult {
+        size_t vertices_before = 0;
+        size_t vertices_after = 0;
+        double seconds = 0.0;
+    };
+
+    std::vector<glm::vec3> compute_gradients(const std::vector<float>& field, int resolution, int step);
+    MarchingCubesMesh marching_cubes(const std::vector<float>& field, int resolution, float threshold, int step = 1);
+    WeldResult weld_vertices(MarchingCubesMesh& mesh, float tolerance);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "Mesh.hpp"
+#include "BVH.hpp"
+
+#include <vector>
+#include <string>
+
+namespace RD3D {
+    /**
+     * An indexed triangle mesh as stored in the binary cache that is kept next to every imported .obj file,
+     * optionally along with a BVH over its triangles.
+     */
+    struct CachedMesh {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        glm::vec3 min = glm::vec3(0.0f);
+        glm::vec3 max = glm::vec3(0.0f);
+        std::vector<BVHNode> bvh_nodes;
+        std::vector<unsigned int> bvh_triangle_order;
+
+        std::vector<glm::vec3> get_positions() const;
+    };
+
+    bool load_cached_mesh(const std::string& obj_path, CachedMesh& mesh, std::string& error);
+    bool write_mesh_cache(const std::string& obj_path, const CachedMesh& mesh);
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "MarchingCubes.hpp"
+
+#include <string>
+
+namespace RD3D {
+    enum class MeshFormat {
+        OBJ = 0,
+        PLY,
+        STL,
+        GLB
+    };
+
+    const char* mesh_format_extension(MeshFormat format);
+    bool write_mesh(const MarchingCubesMesh& mesh, const std::string& path, MeshFormat format);
+}
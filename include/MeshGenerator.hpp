@@ -3,17 +3,209 @@
 
 #include "Shader.hpp"
 #include "OrbitalCamera.hpp"
+#include "MarchingCubes.hpp"
+#include "MeshSimplifier.hpp"
+#include "MeshSmoother.hpp"
+#include "MeshExporter.hpp"
+#include "SequenceRecorder.hpp"
+#include "MeshStatistics.hpp"
 
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace RD3D {
     /**
-     * A utility struct for use in the Marching Cubes Shader to write vertices from a
-     * compute shader to a vertex array.
+     * How exported meshes are extracted from the grid. Surface Nets always runs on the CPU.
      */
-    struct MarchingCubeVertex {
-        alignas(8) glm::vec3 pos;
-        alignas(8) glm::vec3 normal;
+    enum class ExtractionMethod {
+        MarchingCubes = 0,
+        SurfaceNets
+    };
+
+    /**
+     * The chemical of the reaction diffusion grid that an isosurface is extracted from.
+     */
+    enum class FieldChannel {
+        U = 0,
+        V
+    };
+
+    // The most isosurfaces extracted at once, matching the size of the extraction shader's uniform arrays
+    constexpr int max_isosurfaces = 4;
+
+    /**
+     * One of the isosurfaces extracted together from the grid, where the chosen chemical crosses its threshold.
+     */
+    struct Isosurface {
+        FieldChannel channel = FieldChannel::V;
+        float threshold = 0.2f;
+        bool visible = true;
+    };
+
+    /**
+     * A brick's slice of the vertex and index buffers, followed by how much of it the
+     * brick's last extracted mesh needs and how many of the brick's cells the surface passes through.
+     */
+    struct MeshChunk {
+        GLuint first_vertex;
+        GLuint vertex_capacity;
+        GLuint first_index;
+        GLuint index_capacity;
+        GLuint vertex_count;
+        GLuint index_count;
+        GLuint active_cells;
+    };
+
+    /**
+     * The indirect dispatch command for the extraction pass, filled in by the pass that finds the
+     * changed bricks, followed by a flag the extraction pass sets when a brick outgrows its chunk.
+     */
+    struct BrickDispatch {
+        GLuint groups_x;
+        GLuint groups_y;
+        GLuint groups_z;
+        GLuint overflow;
+    };
+
+    struct DrawElementsCommand {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+
+    /**
+     * The GPU buffers holding the mesh extracted at one level of detail, where each
+     * edge of a Marching Cubes cell spans step cells of the simulation grid.
+     * 
+     * The mesh is split into bricks of 7^3 cells, or 8^3 grid points, so that a single work group covers a brick.
+     * Every isosurface has its own chunk and draw command for each brick, with the chunks and draw commands of
+     * the first surface's bricks followed by those of the second surface and so on.
+     */
+    struct MeshLevel {
+        static constexpr int brick_cells = 7;
+
+        int step;
+        int cells_per_axis = 0;
+        int bricks_per_axis = 0;
+        int surface_count = 0;
+        size_t vertex_capacity = 0;
+        size_t index_capacity = 0;
+        bool force_remesh = true;
+        unsigned long long extracted_version = 0;
+        size_t remeshed_bricks = 0;
+
+        GLuint vao = 0;
+        GLuint vbo;
+        GLuint ebo;
+        GLuint dirty_bricks_ssbo;
+        GLuint dispatch_buffer;
+        GLuint extracted_values_ssbo;
+        GLuint chunks_ssbo;
+        GLuint draw_commands_buffer;
+
+        // A persistently mapped copy of the dispatch buffer made after every generation, followed by a copy of the chunks
+        // while statistics are collected, readable once status_fence has signalled
+        GLuint status_buffer = 0;
+        const BrickDispatch* status = nullptr;
+        const MeshChunk* status_chunks = nullptr;
+        bool status_has_chunks = false;
+        GLsync status_fence = 0;
+
+        int brick_count() const { return bricks_per_axis * bricks_per_axis * bricks_per_axis; }
+        int chunk_count() const { return surface_count * brick_count(); }
+    };
+
+    enum class ExportStage {
+        Generating = 0,
+        Copying,
+        Extracting,
+        Smoothing,
+        Simplifying,
+        Writing,
+        Done
+    };
+
+    /**
+     * A mesh export running in the background. A GPU mesh is first remeshed in full until no brick overflows.
+     * What the export needs from the GPU is then copied into a staging buffer behind a fence, and once the fence has signalled the mapped buffer is handed to a worker thread which
+     * extracts, simplifies and writes the mesh.
+     */
+    struct ExportJob {
+        GLuint staging_buffer = 0;
+        GLsizeiptr staging_size = 0;
+        GLsync fence = 0;
+        std::thread worker;
+        std::atomic<ExportStage> stage = ExportStage::Copying;
+
+        // Settings captured when the export was started, so the GUI can change them while it runs
+        std::string path;
+        MeshFormat format;
+        int grid_resolution;
+        int step;
+        float threshold;
+        ExtractionMethod method;
+        bool from_field;
+        bool smooth;
+        SmoothingSettings smoothing;
+        bool simplify;
+        SimplificationSettings simplification;
+
+        // The level and surface of the GPU mesh, and the layout of its copy in the staging buffer, when not copying the field
+        int level = 0;
+        int surface = 0;
+        size_t brick_count = 0;
+        size_t vertex_capacity = 0;
+        size_t index_capacity = 0;
+
+        WeldResult weld_result;
+        SimplificationResult simplification_result;
+        bool written = false;
+    };
+
+    struct SmoothedSurface {
+        GLuint vao = 0;
+        GLuint vbo;
+        GLuint ebo;
+        GLsizei index_count = 0;
+        MarchingCubesMesh mesh;
+    };
+
+    /**
+     * A smoothed copy of every isosurface in the viewport, welded and smoothed on a worker thread from a read back
+     * of the level's chunks, and drawn in place of the chunks once it is ready. The read back goes through a staging
+     * buffer behind a fence like an export's, so the render thread never waits for it.
+     */
+    struct SmoothedViewport {
+        // A version no extraction has, for when the smoothed surfaces have to be redone
+        static constexpr unsigned long long outdated = ~0ull;
+
+        std::array<SmoothedSurface, max_isosurfaces> surfaces;
+
+        // The level, version and layout of the mesh that was last read back, which is being or has been smoothed
+        int level = -1;
+        unsigned long long version = outdated;
+        int surface_count = 0;
+        size_t brick_count = 0;
+        size_t vertex_capacity = 0;
+        int frames_since_smoothing = 0;
+
+        // The level, version and number of surfaces uploaded by the last worker to finish
+        int uploaded_level = -1;
+        unsigned long long uploaded_version = outdated;
+        int uploaded_surfaces = 0;
+
+        GLuint staging_buffer = 0;
+        GLsizeiptr staging_size = 0;
+        GLsync fence = 0;
+
+        std::thread worker;
+        std::atomic<bool> done = false;
     };
 
     /**
@@ -23,22 +215,73 @@ namespace RD3D {
     class MeshGenerator {
     public:
         MeshGenerator(int grid_resolution);
+        ~MeshGenerator();
 
-        void generate(int grid_resolution, GLuint grid_texture);
+        void generate(int grid_resolution, GLuint grid_texture, unsigned long long grid_version);
         void resize(int grid_resolution);
-        void draw(OrbitalCamera& camera, int grid_resolution);
-        void export_to_obj(int grid_resolution);
+        void draw(OrbitalCamera& camera, bool animating);
+        void export_mesh(int grid_resolution, GLuint grid_texture);
+        void update_export(int grid_resolution, GLuint grid_texture);
+        void record_sequence(int grid_resolution, GLuint grid_texture, unsigned long long time_steps);
+        bool is_exporting() const;
+        bool has_pending_work() const;
+        const MeshStatistics& get_statistics() const;
 
-        void draw_gui(int grid_resolution);
+        void draw_gui(int grid_resolution, GLuint grid_texture);
     private:
+        ComputeShader changes_shader;
         ComputeShader marching_cubes_shader;
         Shader mesh_shader;
 
-        GLuint mesh_vbo;
-        GLuint mesh_vao;
-        float threshold = 0.2f;
+        // Extraction steps of 1, 2, 4 and 8 cells, each level kept resident once it has been used
+        std::array<MeshLevel, 4> levels;
+        int viewport_level = 1;
+        int export_level = 0;
+
+        // Extracted together in one pass, and exported and recorded one at a time
+        std::vector<Isosurface> isosurfaces = {Isosurface{}};
+        int export_surface = 0;
+        float remesh_tolerance = 0.002f;
+        bool cpu_export = false;
+        ExtractionMethod export_method = ExtractionMethod::MarchingCubes;
+        MeshFormat export_format = MeshFormat::OBJ;
+
+        // Optional decimation of exported meshes, with the outcome of the last export for the GUI
+        bool simplify_export = false;
+        float simplify_percent = 25.0f;
+        float simplify_max_error = 0.0f;
+        SimplificationResult last_simplification;
+        WeldResult last_weld;
+        std::unique_ptr<ExportJob> export_job;
+        bool last_export_failed = false;
+
+        // Taubin smoothing of exported meshes and, every smooth_interval frames while it changes, of the viewport mesh
+        bool smooth_export = false;
+        bool smooth_viewport = false;
+        int smooth_interval = 10;
+        SmoothingSettings smoothing;
+        SmoothedViewport smoothed_viewport;
+
+        // Summed from the viewport level's status buffer after every generation while enabled
+        bool collect_statistics = false;
+        MeshStatistics statistics;
+        GLuint extraction_query = 0;
+        bool extraction_query_pending = false;
+        double upload_seconds = 0.0;
+
+        // Records the surface at the export step every record_interval time steps
+        SequenceRecorder recorder;
+        int record_interval = 50;
 
-        void init_buffers(int grid_resolution);
+        void generate_level(MeshLevel& level, int grid_resolution, GLuint grid_texture, bool force_remesh);
+        void copy_level_status(MeshLevel& level);
+        void poll_level_status(MeshLevel& level, int grid_resolution, GLuint grid_texture);
+        void remesh_all();
+        void layout_chunks(MeshLevel& level);
+        void allocate_level(MeshLevel& level, int grid_resolution);
+        void update_smoothed_viewport(int grid_resolution);
+        void gather_timings(double generate_seconds);
+        void gather_statistics(const MeshLevel& level);
         void init_marching_cubes_tables();
     };
 }
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+#include "MarchingCubes.hpp"
+
+#include <cstddef>
+
+namespace RD3D {
+    /**
+     * When to stop simplifying a mesh. Simplification stops at whichever limit is reached first.
+     */
+    struct SimplificationSettings {
+        // Fraction of the mesh's triangles to keep
+        float target_ratio = 0.25f;
+
+        // Largest distance a collapse may move the surface, or 0 for no bound
+        float max_error = 0.0f;
+    };
+
+    struct SimplificationResult {
+        size_t triangles_before = 0;
+        size_t triangles_after = 0;
+        double seconds = 0.0;
+    };
+
+    SimplificationResult simplify_mesh(MarchingCubesMesh& mesh, const SimplificationSettings& settings);
+}
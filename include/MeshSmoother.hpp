@@ -0,0 +1,23 @@
+#pragma once
+#include "MarchingCubes.hpp"
+
+#include <cstddef>
+
+namespace RD3D {
+    /**
+     * Taubin smoothing alternates a shrinking step of lambda with an inflating step of mu, with mu < -lambda,
+     * which removes the grid's stair steps without shrinking the surface as a whole.
+     */
+    struct SmoothingSettings {
+        int iterations = 10;
+        float lambda = 0.5f;
+        float mu = -0.53f;
+    };
+
+    struct SmoothingResult {
+        size_t vertices = 0;
+        double seconds = 0.0;
+    };
+
+    SmoothingResult smooth_mesh(MarchingCubesMesh& mesh, const SmoothingSettings& settings);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace RD3D {
+    /**
+     * What the last generation of the viewport mesh produced and what it cost, for sizing the mesh buffers and
+     * spotting performance regressions. Counts cover every isosurface of the level, and buffer sizes are in bytes.
+     */
+    struct MeshStatistics {
+        int step = 0;
+        int surface_count = 0;
+        size_t bricks = 0;
+        size_t remeshed_bricks = 0;
+
+        // Cells that a surface passes through, and what was emitted for them. Vertices on the faces between
+        // bricks are counted once for each brick
+        size_t active_cells = 0;
+        size_t vertices = 0;
+        size_t triangles = 0;
+        std::vector<size_t> surface_triangles;
+
+        // The bytes of the vertex and index buffers filled by the mesh against the bytes allocated for them, and
+        // the bytes of the per brick chunk tables, draw commands and change detection values
+        size_t vertex_bytes_used = 0;
+        size_t vertex_bytes_allocated = 0;
+        size_t index_bytes_used = 0;
+        size_t index_bytes_allocated = 0;
+        size_t brick_bytes_allocated = 0;
+
+        // GPU time of the extraction passes, CPU time spent issuing the generation and checking the status of the
+        // previous one, and CPU time spent uploading chunk layouts and smoothed meshes
+        double extraction_ms = 0.0;
+        double generate_ms = 0.0;
+        double upload_ms = 0.0;
+
+        size_t bytes_used() const { return vertex_bytes_used + index_bytes_used; }
+        size_t bytes_allocated() const { return vertex_bytes_allocated + index_bytes_allocated + brick_bytes_allocated; }
+
+        std::string to_json() const;
+    };
+}
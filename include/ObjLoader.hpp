@@ -0,0 +1,29 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+
+namespace RD3D {
+    /**
+     * Indices of the position, texture coordinate, and normal of one corner of a face.
+     * Missing texture coordinates and normals are -1.
+     */
+    struct ObjIndex {
+        int position;
+        int texcoord;
+        int normal;
+    };
+
+    /**
+     * The geometry of a Wavefront .obj file. Faces are triangulated, so every three indices form a triangle.
+     */
+    struct ObjData {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> texcoords;
+        std::vector<glm::vec3> normals;
+        std::vector<ObjIndex> indices;
+    };
+
+    bool load_obj(const std::string& path, ObjData& data, std::string& error);
+}
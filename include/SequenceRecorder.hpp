@@ -0,0 +1,102 @@
+#pragma once
+#include <glad/glad.h>
+
+#include "MarchingCubes.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RD3D {
+    /**
+     * Records the isosurface every few time steps of a run into a single .rd3dseq file. The file is a header followed
+     * by one self-describing record per frame, so it can be read as a stream, and ends with an index of the keyframes
+     * for random access.
+     *
+     * A frame whose triangles are the same as the previous frame's stores only each vertex's movement, quantized to
+     * 16 bit steps, and its normals as 16 bit fixed point. Every other frame is a keyframe holding full positions,
+     * normals and indices, and keyframes are also forced at a fixed interval to bound the work of seeking.
+     *
+     * The field is copied into a pixel pack buffer behind a fence, and extraction and encoding run on a worker
+     * thread, so recording never waits on the GPU or blocks the simulation. Frames that arrive while the worker
+     * is too far behind are dropped and counted.
+     */
+    class SequenceRecorder {
+    public:
+        ~SequenceRecorder();
+
+        bool start(const std::string& path, int grid_resolution, int step, GLenum channel, float threshold, int interval);
+        void stop();
+        void update(int grid_resolution, GLuint grid_texture, unsigned long long time_steps);
+        bool is_recording() const;
+        bool has_pending_work() const;
+
+        void draw_gui();
+    private:
+        static constexpr int max_pending_frames = 4;
+        static constexpr int keyframe_interval = 30;
+
+        struct Capture {
+            GLuint pbo;
+            GLsync fence;
+            unsigned long long time_step;
+        };
+
+        struct Frame {
+            unsigned long long time_step;
+            std::vector<float> field;
+        };
+
+        struct KeyframeEntry {
+            uint32_t frame;
+            uint32_t reserved;
+            uint64_t offset;
+        };
+
+        // Settings of the current recording, only changed while the worker is not running
+        int grid_resolution = 0;
+        int step = 1;
+        GLenum channel = GL_GREEN;
+        float threshold = 0.0f;
+        int interval = 1;
+        float quantum = 0.0f;
+        unsigned long long next_capture = 0;
+        bool recording = false;
+        std::deque<Capture> captures;
+
+        // Frames waiting for the worker
+        std::thread worker;
+        std::mutex queue_mutex;
+        std::condition_variable queue_changed;
+        std::deque<Frame> queue;
+        bool stopping = false;
+
+        // Owned by the worker while it runs
+        std::ofstream file;
+        uint64_t file_offset = 0;
+        std::vector<unsigned int> previous_indices;
+        std::vector<glm::vec3> previous_positions;
+        std::vector<KeyframeEntry> keyframes;
+        int frames_since_keyframe = 0;
+
+        std::atomic<bool> finished = true;
+        std::atomic<int> frames_written = 0;
+        std::atomic<int> keyframes_written = 0;
+        std::atomic<int> frames_dropped = 0;
+        std::atomic<uint64_t> bytes_written = 0;
+
+        // Set by the worker at the first failed write, after which frames are dropped and the recording stops
+        std::atomic<bool> write_failed = false;
+
+        void capture(GLuint grid_texture, unsigned long long time_step);
+        void worker_loop();
+        void write_frame(const Frame& frame);
+        void write(const void* data, size_t bytes);
+    };
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace RD3D {
+    /**
+     * A signed distance field of a triangle mesh, sampled on a regular grid in the mesh's local space.
+     * Distances are negative inside of the mesh and positive outside of it.
+     */
+    class SignedDistanceField {
+    public:
+        SignedDistanceField(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, int resolution);
+
+        float sample(glm::vec3 p) const;
+    private:
+        glm::vec3 origin;
+        float cell_size;
+        int nx, ny, nz;
+        std::vector<float> distances;
+
+        size_t index(int i, int j, int k) const;
+        void propagate(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, std::vector<int>& closest_triangles);
+    };
+}
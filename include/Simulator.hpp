@@ -20,6 +20,12 @@ namespace RD3D {
     public:
         GLuint grid_texture;
         int grid_resolution = 64;
+
+        // Incremented whenever the contents of the grid texture change, so that views of it know when to update
+        unsigned long long grid_version = 1;
+
+        // The number of time steps simulated since the grid was last cleared
+        unsigned long long time_steps = 0;
         Boundary boundary;
 
         Simulator();
@@ -30,6 +36,7 @@ namespace RD3D {
         void enable_brush(int x, int y, int z);
         void disable_brush();
         void toggle_pause();
+        bool is_animating() const;
 
         void draw_gui(MeshGenerator& mesh_generator, SliceViewer& slice_viewer);
     private:
@@ -50,10 +57,32 @@ namespace RD3D {
         bool brush_enabled = false;
 
         ComputeShader shader;
-        std::vector<float> grid;
+        ComputeShader apply_boundary_shader;
+
+        // CPU mirror of only the boundary channel, the chemical concentrations live solely on the GPU
+        std::vector<float> boundary_grid;
+
+        // The boundary is uploaded to the GPU in cubic bricks so that small edits only transfer the bricks they touch
+        static constexpr int brick_size = 16;
+        static constexpr int staging_brick_capacity = 64;
+        int bricks_per_axis = 0;
+        int texture_resolution = 0;
+        std::vector<GLuint> dirty_bricks;
+
+        GLuint boundary_texture;
+        GLuint dirty_bricks_ssbo;
+        GLuint staging_pbo;
+        float* staging_ptr = nullptr;
+        GLsync staging_fence = nullptr;
 
         void set_shader_uniforms();
-        void load_data_to_texture();
+        void init_staging_buffer();
+        void allocate_textures();
+        void wait_for_staging_buffer();
+        void mark_dirty(int x, int y, int z);
+        void mark_all_dirty();
+        void load_boundary_to_texture();
+        void apply_boundary(bool all_bricks);
 
         friend class Boundary;
     };
@@ -12,7 +12,7 @@ namespace RD3D {
     public:
         SliceViewer(int grid_resolution);
 
-        void render(int grid_resolution, GLuint grid_texture);
+        void render(int grid_resolution, GLuint grid_texture, unsigned long long grid_version);
         void resize(int grid_resolution);
         void draw_gui(Simulator* simulator, int grid_resolution, int ui_sidebar_width);
     private:
@@ -25,6 +25,11 @@ namespace RD3D {
 
         int slice_depth = 0;
 
+        // What the slice texture currently shows, so that it is only rendered again when the grid or depth changes
+        bool rendered = false;
+        unsigned long long rendered_version = 0;
+        int rendered_depth = 0;
+
         void init_buffers(int grid_resolution);
     };
 }
\ No newline at end of file
@@ -0,0 +1,8 @@
+#pragma once
+#include "MarchingCubes.hpp"
+
+#include <vector>
+
+namespace RD3D {
+    MarchingCubesMesh surface_nets(const std::vector<float>& field, int resolution, float threshold, int step = 1);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace RD3D {
+    /**
+     * A fixed set of worker threads that CPU heavy work such as voxelization and meshing
+     * is split across. A single pool is shared by the whole application.
+     */
+    class ThreadPool {
+    public:
+        ThreadPool(int thread_count);
+        ~ThreadPool();
+
+        static ThreadPool& get();
+
+        int size() const;
+        void parallel_for(int begin, int end, const std::function<void(int)>& fn);
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex tasks_mutex;
+        std::condition_variable tasks_available;
+        bool stopping = false;
+
+        void enqueue(std::function<void()> task);
+        void worker_loop();
+    };
+}
@@ -32,6 +32,9 @@ private:
     double fps;
     std::vector<float> fps_tracker;
 
+    // Frames still to draw before the loop goes back to sleeping until the next event
+    int wake_frames = 0;
+
     void initialize_window(int window_width, int window_height);
     void calculate_framerate();
     void init_gui(std::string font_path, int font_size);
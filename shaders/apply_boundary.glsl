@@ -0,0 +1,24 @@
+#version 460 core
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+layout (rgba32f, binding = 0) uniform image3D grid;
+layout (r32f, binding = 1) uniform readonly image3D boundary;
+
+layout (binding = 5, std430) readonly buffer ssbo5 {uint dirty_bricks[];};
+
+uniform int grid_resolution;
+uniform int brick_size;
+uniform int bricks_per_axis;
+uniform bool all_bricks;
+
+// Copies the boundary values into the boundary channel of the grid, leaving the chemical concentrations untouched
+void main() {
+    ivec3 location = ivec3(gl_GlobalInvocationID.xyz);
+    if (any(greaterThanEqual(location, ivec3(grid_resolution)))) return;
+
+    ivec3 brick = location / brick_size;
+    if (!all_bricks && dirty_bricks[brick.x + brick.y * bricks_per_axis + brick.z * bricks_per_axis * bricks_per_axis] == 0) return;
+
+    vec4 grid_value = imageLoad(grid, location);
+    grid_value.b = imageLoad(boundary, location).r;
+    imageStore(grid, location, grid_value);
+}
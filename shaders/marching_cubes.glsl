@@ -1,87 +1,253 @@
 #version 460
-layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
 
 struct Vertex {
     vec3 pos;
     vec3 normal;
 };
 
-layout (binding = 1, std430) readonly buffer ssbo1 {int edge_table[256];};
-layout (binding = 2, std430) readonly buffer ssbo2 {int vertex_table[24];};
+// A brick's slice of the vertex and index buffers, how much of it the brick's mesh needs, and how many of the
+// brick's cells the surface passes through
+struct Chunk {
+    uint first_vertex;
+    uint vertex_capacity;
+    uint first_index;
+    uint index_capacity;
+    uint vertex_count;
+    uint index_count;
+    uint active_cells;
+};
+
+struct DrawCommand {
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int base_vertex;
+    uint base_instance;
+};
+
 layout (binding = 3, std430) readonly buffer ssbo3 {int triangle_table[4096];};
-layout (binding = 4, std430) buffer ssbo4 {Vertex vertices[];};
+layout (binding = 4, std430) writeonly buffer ssbo4 {Vertex vertices[];};
+layout (binding = 6, std430) readonly buffer ssbo6 {uint dirty_bricks[];};
+layout (binding = 7, std430) buffer ssbo7 {
+    uint extract_groups_x;
+    uint extract_groups_y;
+    uint extract_groups_z;
+    uint overflow;
+};
+layout (binding = 8, std430) writeonly buffer ssbo8 {uint triangle_indices[];};
+layout (binding = 9, std430) writeonly buffer ssbo9 {vec2 extracted_values[];};
+
+// Every surface has a chunk and a draw command per brick, the surfaces' bricks one after the other
+layout (binding = 10, std430) buffer ssbo10 {Chunk chunks[];};
+layout (binding = 11, std430) writeonly buffer ssbo11 {DrawCommand draw_commands[];};
 
 uniform float grid_resolution;
-uniform float threshold;
+uniform int step;
+uniform int cells_per_axis;
+uniform int bricks_per_axis;
+uniform int surface_count;
+uniform float thresholds[4];
+uniform int channels[4];
 uniform sampler3D grid_tex;
 
-void main() {
-    vec3 pos = 2.0 * vec3(gl_GlobalInvocationID.x / grid_resolution, gl_GlobalInvocationID.y / grid_resolution, gl_GlobalInvocationID.z / grid_resolution);
-    ivec3 loc = ivec3(gl_GlobalInvocationID.xyz);
-
-    float shift = 2.0 / (grid_resolution);
-
-    vec3 shifts[8] = vec3[](
-        vec3(0.0, 0.0, 0.0),
-        vec3(0.0, 0.0, shift),
-        vec3(shift, 0.0, shift),
-        vec3(shift, 0.0, 0.0),
-        vec3(0.0, shift, 0.0),
-        vec3(0.0, shift, shift),
-        vec3(shift, shift, shift),
-        vec3(shift, shift, 0.0)
+// Each edge of a cell is owned by the corner it starts from, as the corner's offset and the edge's axis
+const ivec4 edge_owners[12] = ivec4[](
+    ivec4(0, 0, 0, 2), ivec4(0, 0, 1, 0), ivec4(1, 0, 0, 2), ivec4(0, 0, 0, 0),
+    ivec4(0, 1, 0, 2), ivec4(0, 1, 1, 0), ivec4(1, 1, 0, 2), ivec4(0, 1, 0, 0),
+    ivec4(0, 0, 0, 1), ivec4(0, 0, 1, 1), ivec4(1, 0, 1, 1), ivec4(1, 0, 0, 1)
+);
+
+const ivec3 corners[8] = ivec3[](
+    ivec3(0, 0, 0), ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(1, 0, 0),
+    ivec3(0, 1, 0), ivec3(0, 1, 1), ivec3(1, 1, 1), ivec3(1, 1, 0)
+);
+
+// Both chemicals at the brick's grid points with a border of one point on every side, and the gradient of the current
+// surface's chemical at each of the brick's points
+shared vec2 values[1000];
+shared vec3 gradients[512];
+shared uvec2 scanned[512];
+shared uint edge_vertices[512];
+shared uint active_cells;
+
+// Grid points lie on the centers of every step-th cell of the simulation grid
+vec3 point_position(ivec3 point) {
+    return (float(step) * vec3(point) + 0.5) / grid_resolution;
+}
+
+// Index into the values of the brick's grid points and their border, where local is relative to the brick's first point
+int value_index(ivec3 local) {
+    return (local.x + 1) + (local.y + 1) * 10 + (local.z + 1) * 100;
+}
+
+// The chemical and threshold of the surface being extracted
+int channel;
+float threshold;
+
+// The current surface's chemical at one of the brick's grid points or their border, relative to the brick's first point
+float field(ivec3 local) {
+    return values[value_index(local)][channel];
+}
+
+// Where the surface crosses one of a cell's edges, in grid points relative to the brick's first point
+vec3 edge_crossing(ivec3 cell, int edge) {
+    ivec4 owner = edge_owners[edge];
+    ivec3 corner = cell + owner.xyz;
+    ivec3 next = corner;
+    next[owner.w]++;
+
+    float from = field(corner);
+    float t = (threshold - from) / (field(next) - from);
+    return mix(vec3(corner), vec3(next), t);
+}
+
+// Extracts the current surface over the brick into one of its chunks, called by every invocation of the work group
+void extract_surface(uint chunk_index, ivec3 local, ivec3 point, uint local_index, bool in_grid) {
+    float value = field(local);
+
+    // Central differences between neighbouring grid points, computed once per point and shared by all of its edges
+    gradients[local_index] = vec3(
+        field(local + ivec3(1, 0, 0)) - field(local - ivec3(1, 0, 0)),
+        field(local + ivec3(0, 1, 0)) - field(local - ivec3(0, 1, 0)),
+        field(local + ivec3(0, 0, 1)) - field(local - ivec3(0, 0, 1))
     );
-    vec3 interpolated[12];
-    vec3 normals[12];
 
-    int cube_index = 0;
-    for (int i = 0; i < 8; i++) {
-        if (texture(grid_tex, pos + shifts[i]).g < threshold) {
-            cube_index |= (1 << i);
+    int edge_mask = 0;
+    if (in_grid) {
+        for (int axis = 0; axis < 3; axis++) {
+            ivec3 next = local;
+            next[axis]++;
+            if (local[axis] < 7 && point[axis] < cells_per_axis && (field(next) < threshold) != (value < threshold)) {
+                edge_mask |= (1 << axis);
+            }
         }
     }
 
-    int edge_mask = edge_table[cube_index];
-    int tri_index = cube_index * 16;
-
-    // Interpolate edge vertices
-    for (int i = 0; i < 12; i++) {
-        if (((edge_mask >> i) & 1) == 1) {
-            vec3 P1 = pos + shifts[vertex_table[i*2]];
-            vec3 P2 = pos + shifts[vertex_table[i*2+1]];
-            float V1 = texture(grid_tex, P1).g;
-            float V2 = texture(grid_tex, P2).g;
-
-            interpolated[i] = mix(P1, P2, (threshold - V1) / (V2 - V1));
-
-            // Use gradients to compute the normal vectors
-            vec3 P = interpolated[i]; 
-            float delta = shift / 2.0;
-            normals[i].x = texture(grid_tex, P + vec3(delta, 0.0, 0.0)).g - texture(grid_tex, P - vec3(delta, 0.0, 0.0)).g;
-            normals[i].y = texture(grid_tex, P + vec3(0.0, delta, 0.0)).g - texture(grid_tex, P - vec3(0.0, delta, 0.0)).g;
-            normals[i].z = texture(grid_tex, P + vec3(0.0, 0.0, delta)).g - texture(grid_tex, P - vec3(0.0, 0.0, delta)).g;
-            normals[i] = -normalize(normals[i]);
+    // Triangles whose corners coincide or fall on a line, where the surface passes through a grid point, are
+    // dropped before they are counted so that they never reach the index buffer
+    int cube_index = 0;
+    uint indices = 0;
+    uint kept_triangles = 0;
+    int tri_index = 0;
+    if (all(lessThan(local, ivec3(7))) && all(lessThan(point, ivec3(cells_per_axis)))) {
+        for (int i = 0; i < 8; i++) {
+            ivec3 corner = local + corners[i];
+            if (field(corner) < threshold) {
+                cube_index |= (1 << i);
+            }
         }
+
+        if (cube_index != 0 && cube_index != 255) atomicAdd(active_cells, 1u);
+
+        tri_index = cube_index * 16;
+        for (int i = 0; i < 15 && triangle_table[tri_index + i] != -1; i += 3) {
+            vec3 a = edge_crossing(local, triangle_table[tri_index + i]);
+            vec3 b = edge_crossing(local, triangle_table[tri_index + i + 1]);
+            vec3 c = edge_crossing(local, triangle_table[tri_index + i + 2]);
+            vec3 n = cross(b - a, c - a);
+            if (dot(n, n) > 1e-12) {
+                kept_triangles |= 1u << (i / 3);
+                indices += 3;
+            }
+        }
+    }
+
+    // Inclusive scan of the vertex and index counts across the brick
+    uvec2 counts = uvec2(bitCount(edge_mask), indices);
+    scanned[local_index] = counts;
+    barrier();
+
+    for (uint offset = 1; offset < 512; offset *= 2) {
+        uvec2 add = local_index >= offset ? scanned[local_index - offset] : uvec2(0);
+        barrier();
+        scanned[local_index] += add;
+        barrier();
+    }
+
+    uvec2 total = scanned[511];
+    uint first_vertex = chunks[chunk_index].first_vertex;
+    uint first_index = chunks[chunk_index].first_index;
+    bool fits = total.x <= chunks[chunk_index].vertex_capacity && total.y <= chunks[chunk_index].index_capacity;
+
+    if (local_index == 0) {
+        chunks[chunk_index].vertex_count = total.x;
+        chunks[chunk_index].index_count = total.y;
+        chunks[chunk_index].active_cells = active_cells;
+        active_cells = 0;
+        draw_commands[chunk_index] = DrawCommand(fits ? total.y : 0, 1, first_index, int(first_vertex), 0);
+        if (!fits) atomicOr(overflow, 1);
+    }
+
+    // A brick that outgrew its chunk is left empty until the chunks are laid out again
+    if (!fits) return;
+
+    uvec2 first = scanned[local_index] - counts;
+    edge_vertices[local_index] = (first.x << 3) | uint(edge_mask);
+
+    uint vertex = first_vertex + first.x;
+    for (int axis = 0; axis < 3; axis++) {
+        if (((edge_mask >> axis) & 1) == 0) continue;
+
+        ivec3 next = local;
+        next[axis]++;
+        float t = (threshold - value) / (field(next) - value);
+
+        // Interpolate the gradients at both ends of the edge to compute the normal vectors
+        vec3 normal = mix(gradients[local_index], gradients[next.x + next.y * 8 + next.z * 64], t);
+
+        vertices[vertex].pos = mix(point_position(point), point_position(point + next - local), t);
+        vertices[vertex].normal = -normalize(normal);
+        vertex++;
     }
+    barrier();
 
-    for (int i = 0; i < 15; i += 3) {
-        int idx = (loc.x + loc.y * int(grid_resolution / 2.0) + loc.z * int(grid_resolution / 2.0) * int(grid_resolution/ 2.0)) * 15;
-        if (triangle_table[tri_index + i] != -1) {
-            vertices[idx + i + 0].pos    = interpolated[triangle_table[tri_index + i + 0]];
-            vertices[idx + i + 0].normal = normals[triangle_table[tri_index + i + 0]];
-
-            vertices[idx + i + 1].pos    = interpolated[triangle_table[tri_index + i + 1]];
-            vertices[idx + i + 1].normal = normals[triangle_table[tri_index + i + 1]];
-
-            vertices[idx + i + 2].pos    = interpolated[triangle_table[tri_index + i + 2]];
-            vertices[idx + i + 2].normal = normals[triangle_table[tri_index + i + 2]];
-        } else {
-            vertices[idx + i + 0].pos = vec3(0.0);
-            vertices[idx + i + 0].normal = vec3(0.0);
-            vertices[idx + i + 1].pos = vec3(0.0);
-            vertices[idx + i + 1].normal = vec3(0.0);
-            vertices[idx + i + 2].pos = vec3(0.0);
-            vertices[idx + i + 2].normal = vec3(0.0);
+    // Indices are relative to the chunk's first vertex, which the draw command adds back
+    uint out_index = first_index + first.y;
+    for (int i = 0; i < 15 && kept_triangles >> (i / 3) != 0u; i += 3) {
+        if (((kept_triangles >> (i / 3)) & 1u) == 0) continue;
+
+        for (int j = i; j < i + 3; j++) {
+            ivec4 owner = edge_owners[triangle_table[tri_index + j]];
+            ivec3 corner = local + owner.xyz;
+            uint packed = edge_vertices[corner.x + corner.y * 8 + corner.z * 64];
+
+            triangle_indices[out_index++] = (packed >> 3) + uint(bitCount(packed & ((1u << owner.w) - 1u)));
         }
     }
-}
\ No newline at end of file
+}
+
+// Extracts the mesh of every surface over one brick of 7^3 cells into the brick's chunk of each surface. The field is
+// read from the texture once for all of the surfaces. Every grid point of the brick owns the edges leading from it in
+// the positive x, y and z directions that stay inside the brick, so the brick's triangles only index its own vertices
+// and it can be remeshed on its own
+void main() {
+    uint brick_index = dirty_bricks[gl_WorkGroupID.x];
+    ivec3 brick = ivec3(brick_index % bricks_per_axis, (brick_index / bricks_per_axis) % bricks_per_axis, brick_index / (bricks_per_axis * bricks_per_axis));
+    ivec3 local = ivec3(gl_LocalInvocationID.xyz);
+    ivec3 point = brick * 7 + local;
+    uint local_index = gl_LocalInvocationIndex;
+    bool in_grid = all(lessThanEqual(point, ivec3(cells_per_axis)));
+    if (local_index == 0) active_cells = 0;
+
+    // Load the field once for the brick and its border, clamping to the edges of the grid like the texture does
+    for (uint i = local_index; i < 1000; i += 512) {
+        ivec3 tile = ivec3(i % 10, (i / 10) % 10, i / 100);
+        ivec3 tile_point = clamp(brick * 7 + tile - 1, ivec3(0), ivec3(cells_per_axis));
+        values[i] = texture(grid_tex, point_position(tile_point)).rg;
+    }
+    barrier();
+
+    extracted_values[brick_index * 512 + local_index] = values[value_index(local)];
+    uint brick_count = uint(bricks_per_axis * bricks_per_axis * bricks_per_axis);
+
+    for (int surface = 0; surface < surface_count; surface++) {
+        channel = channels[surface];
+        threshold = thresholds[surface];
+        extract_surface(brick_index + uint(surface) * brick_count, local, point, local_index, in_grid);
+
+        // The next surface reuses the shared gradients, scan and edge vertices
+        barrier();
+    }
+}
+
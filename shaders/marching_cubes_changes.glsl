@@ -0,0 +1,54 @@
+#version 460
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+
+layout (binding = 6, std430) writeonly buffer ssbo6 {uint dirty_bricks[];};
+
+// The dispatch command for the extraction pass, followed by a flag set when a brick outgrows its chunk
+layout (binding = 7, std430) buffer ssbo7 {
+    uint extract_groups_x;
+    uint extract_groups_y;
+    uint extract_groups_z;
+    uint overflow;
+};
+
+// Both chemicals at the grid points each brick was last extracted from, 8^3 per brick
+layout (binding = 9, std430) readonly buffer ssbo9 {vec2 extracted_values[];};
+
+uniform float grid_resolution;
+uniform int step;
+uniform int cells_per_axis;
+uniform int bricks_per_axis;
+uniform float tolerance;
+uniform bool force_remesh;
+
+// Bit 0 is set if any surface is extracted from u and bit 1 if any is extracted from v, so that changes to a
+// chemical no surface uses are ignored
+uniform int used_channels;
+uniform sampler3D grid_tex;
+
+shared uint max_delta;
+
+// Finds the largest change of the field over each brick's grid points since it was last extracted,
+// and lists the bricks where it exceeds the tolerance
+void main() {
+    ivec3 brick = ivec3(gl_WorkGroupID.xyz);
+    ivec3 point = brick * 7 + ivec3(gl_LocalInvocationID.xyz);
+    uint brick_index = brick.x + brick.y * bricks_per_axis + brick.z * bricks_per_axis * bricks_per_axis;
+
+    if (gl_LocalInvocationIndex == 0) max_delta = 0;
+    barrier();
+
+    if (all(lessThanEqual(point, ivec3(cells_per_axis)))) {
+        vec2 value = texture(grid_tex, (float(step) * vec3(point) + 0.5) / grid_resolution).rg;
+        vec2 change = abs(value - extracted_values[brick_index * 512 + gl_LocalInvocationIndex]);
+        float delta = max((used_channels & 1) != 0 ? change.x : 0.0, (used_channels & 2) != 0 ? change.y : 0.0);
+
+        // Non-negative floats order the same way as their bits
+        atomicMax(max_delta, floatBitsToUint(delta));
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0 && (force_remesh || uintBitsToFloat(max_delta) > tolerance)) {
+        dirty_bricks[atomicAdd(extract_groups_x, 1)] = brick_index;
+    }
+}
@@ -0,0 +1,325 @@
+#include "BVH.hpp"
+#include "Geometry.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+
+using namespace RD3D;
+
+static constexpr int sah_bins = 16;
+static constexpr int max_leaf_size = 4;
+
+// Entries of the traversal stacks, which hold one more node than the depth of the deepest node
+static constexpr int traversal_stack_size = 64;
+
+// Subtrees with more triangles than this are built on separate threads
+static constexpr int parallel_build_threshold = 4096;
+
+/**
+ * Build the hierarchy over every triangle of a mesh.
+ * 
+ * @param positions Vertex positions of the mesh
+ * @param indices Three indices into positions for each triangle of the mesh
+ */
+BVH::BVH(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+    int triangle_count = indices.size() / 3;
+    std::vector<int> refs(triangle_count);
+    std::vector<glm::vec3> bounds_min(triangle_count), bounds_max(triangle_count), centroids(triangle_count);
+
+    ThreadPool::get().parallel_for(0, (triangle_count + 4095) / 4096, [&](int chunk) {
+        int end = std::min(triangle_count, (chunk + 1) * 4096);
+        for (int t = chunk * 4096; t < end; t++) {
+            glm::vec3 a = positions[indices[3 * t + 0]];
+            glm::vec3 b = positions[indices[3 * t + 1]];
+            glm::vec3 c = positions[indices[3 * t + 2]];
+            refs[t] = t;
+            bounds_min[t] = glm::min(a, glm::min(b, c));
+            bounds_max[t] = glm::max(a, glm::max(b, c));
+            centroids[t] = 0.5f * (bounds_min[t] + bounds_max[t]);
+        }
+    });
+
+    // A binary tree with at least one triangle per leaf never needs more than 2n - 1 nodes
+    nodes.resize(std::max(1, 2 * triangle_count - 1));
+    node_count = 1;
+    if (triangle_count > 0) build(0, 0, triangle_count, refs, bounds_min, bounds_max, centroids, 0);
+    else nodes[0] = {glm::vec3(FLT_MAX), 0, glm::vec3(-FLT_MAX), 0};
+    nodes.resize(node_count);
+
+    triangle_order = std::vector<unsigned int>(refs.begin(), refs.end());
+    gather_triangles(positions, indices);
+}
+
+/**
+ * Restore a hierarchy that was built earlier, e.g. one stored in a mesh cache.
+ * 
+ * @param positions Vertex positions of the mesh
+ * @param indices Three indices into positions for each triangle of the mesh
+ * @param nodes The nodes of the hierarchy
+ * @param triangle_order The leaf order of the mesh's triangles
+ */
+BVH::BVH(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, std::vector<BVHNode> nodes, std::vector<unsigned int> triangle_order) :
+    nodes(std::move(nodes)),
+    triangle_order(std::move(triangle_order))
+{
+    gather_triangles(positions, indices);
+}
+
+/**
+ * Check whether a hierarchy that was built earlier, e.g. one read from a mesh cache, can be traversed safely.
+ * Every child and triangle has to be within the arrays, children have to come after their parent as they do
+ * when built, and the tree has to be shallow enough for the traversal stacks.
+ * 
+ * @param nodes The nodes of the hierarchy
+ * @param triangle_order The leaf order of the mesh's triangles
+ * @param triangle_count The number of triangles of the mesh
+ */
+bool BVH::is_valid(const std::vector<BVHNode>& nodes, const std::vector<unsigned int>& triangle_order, size_t triangle_count) {
+    if (nodes.empty() || triangle_order.size() != triangle_count) return false;
+    for (unsigned int t : triangle_order)
+        if (t >= triangle_count) return false;
+
+    // Without triangles the root is an empty box, which no traversal ever enters
+    if (triangle_count == 0) return nodes.size() == 1 && nodes[0].min.x > nodes[0].max.x;
+
+    std::vector<int> depths(nodes.size(), -1);
+    depths[0] = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const BVHNode& node = nodes[i];
+        if (depths[i] < 0) continue;
+        if (depths[i] >= traversal_stack_size) return false;
+
+        if (node.count == 0) {
+            if (node.first <= (int64_t)i || (size_t)node.first + 1 >= nodes.size()) return false;
+            depths[node.first] = std::max(depths[node.first], depths[i] + 1);
+            depths[node.first + 1] = std::max(depths[node.first + 1], depths[i] + 1);
+        } else if (node.count < 0 || node.first < 0 || (size_t)node.first + node.count > triangle_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Get the nodes of the hierarchy.
+ */
+const std::vector<BVHNode>& BVH::get_nodes() const {
+    return nodes;
+}
+
+/**
+ * Get the index of the mesh triangle at each position of the leaf order.
+ */
+const std::vector<unsigned int>& BVH::get_triangle_order() const {
+    return triangle_order;
+}
+
+/**
+ * Conservatively test whether any triangle of the mesh passes through an axis aligned box.
+ * 
+ * @param lo Minimum corner of the box
+ * @param hi Maximum corner of the box
+ */
+bool BVH::overlaps_box(glm::vec3 lo, glm::vec3 hi) const {
+    int stack[traversal_stack_size];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const BVHNode& node = nodes[stack[--top]];
+        if (node.min.x > hi.x || node.min.y > hi.y || node.min.z > hi.z) continue;
+        if (node.max.x < lo.x || node.max.y < lo.y || node.max.z < lo.z) continue;
+
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+
+        for (int t = node.first; t < node.first + node.count; t++) {
+            glm::vec3 a = triangles[3 * t + 0], b = triangles[3 * t + 1], c = triangles[3 * t + 2];
+            glm::vec3 t_min = glm::min(a, glm::min(b, c));
+            glm::vec3 t_max = glm::max(a, glm::max(b, c));
+            if (t_min.x <= hi.x && t_min.y <= hi.y && t_min.z <= hi.z && t_max.x >= lo.x && t_max.y >= lo.y && t_max.z >= lo.z) return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Find every x coordinate at which the ray starting at (x_from, y, z) and pointing along the positive x axis
+ * crosses the mesh. The crossings are appended to the given vector in no particular order.
+ * 
+ * @param y The y coordinate of the ray
+ * @param z The z coordinate of the ray
+ * @param x_from The x coordinate where the ray starts
+ * @param crossings Vector to append the crossings to
+ */
+void BVH::x_ray_crossings(float y, float z, float x_from, std::vector<float>& crossings) const {
+    int stack[traversal_stack_size];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const BVHNode& node = nodes[stack[--top]];
+        if (node.max.x < x_from || y < node.min.y || y > node.max.y || z < node.min.z || z > node.max.z) continue;
+
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+
+        for (int t = node.first; t < node.first + node.count; t++) {
+            glm::vec3 a = triangles[3 * t + 0], b = triangles[3 * t + 1], c = triangles[3 * t + 2];
+            double wa, wb, wc;
+            if (point_in_triangle_2d(y, z, a.y, a.z, b.y, b.z, c.y, c.z, wa, wb, wc)) {
+                float x = (float)(wa * a.x + wb * b.x + wc * c.x);
+                if (x >= x_from) crossings.push_back(x);
+            }
+        }
+    }
+}
+
+/**
+ * Test whether a point lies inside of the mesh by counting how often a ray from it crosses the mesh.
+ * 
+ * @param p The point to test
+ */
+bool BVH::is_inside(glm::vec3 p) const {
+    std::vector<float> crossings;
+    x_ray_crossings(p.y, p.z, p.x, crossings);
+    return crossings.size() % 2 == 1;
+}
+
+/**
+ * Recursively build the subtree rooted at the given node over refs[first, first + count).
+ * The split is chosen with a binned surface area heuristic, and large subtrees are built in parallel.
+ */
+void BVH::build(int node, int first, int count, std::vector<int>& refs, const std::vector<glm::vec3>& bounds_min, const std::vector<glm::vec3>& bounds_max, const std::vector<glm::vec3>& centroids, int depth) {
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX), c_lo(FLT_MAX), c_hi(-FLT_MAX);
+    for (int i = first; i < first + count; i++) {
+        lo = glm::min(lo, bounds_min[refs[i]]);
+        hi = glm::max(hi, bounds_max[refs[i]]);
+        c_lo = glm::min(c_lo, centroids[refs[i]]);
+        c_hi = glm::max(c_hi, centroids[refs[i]]);
+    }
+    nodes[node] = {lo, first, hi, count};
+
+    // A depth of 60 can never exceed the traversal stacks
+    if (count <= max_leaf_size || depth >= 60) return;
+
+    auto area = [](glm::vec3 lo, glm::vec3 hi) {
+        glm::vec3 e = glm::max(hi - lo, glm::vec3(0.0f));
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    };
+
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    int best_split = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = c_hi[axis] - c_lo[axis];
+        if (extent <= 0.0f) continue;
+
+        int bin_counts[sah_bins] = {};
+        glm::vec3 bin_min[sah_bins], bin_max[sah_bins];
+        for (int b = 0; b < sah_bins; b++) {
+            bin_min[b] = glm::vec3(FLT_MAX);
+            bin_max[b] = glm::vec3(-FLT_MAX);
+        }
+
+        for (int i = first; i < first + count; i++) {
+            int b = std::min(sah_bins - 1, (int)((centroids[refs[i]][axis] - c_lo[axis]) / extent * sah_bins));
+            bin_counts[b]++;
+            bin_min[b] = glm::min(bin_min[b], bounds_min[refs[i]]);
+            bin_max[b] = glm::max(bin_max[b], bounds_max[refs[i]]);
+        }
+
+        // Sweep from the right to get the cost of every right hand side, then from the left to evaluate each split
+        float right_area[sah_bins];
+        int right_count[sah_bins];
+        glm::vec3 r_lo(FLT_MAX), r_hi(-FLT_MAX);
+        int r_count = 0;
+        for (int b = sah_bins - 1; b > 0; b--) {
+            r_lo = glm::min(r_lo, bin_min[b]);
+            r_hi = glm::max(r_hi, bin_max[b]);
+            r_count += bin_counts[b];
+            right_area[b] = area(r_lo, r_hi);
+            right_count[b] = r_count;
+        }
+
+        glm::vec3 l_lo(FLT_MAX), l_hi(-FLT_MAX);
+        int l_count = 0;
+        for (int b = 0; b < sah_bins - 1; b++) {
+            l_lo = glm::min(l_lo, bin_min[b]);
+            l_hi = glm::max(l_hi, bin_max[b]);
+            l_count += bin_counts[b];
+            if (l_count == 0 || right_count[b + 1] == 0) continue;
+
+            float cost = l_count * area(l_lo, l_hi) + right_count[b + 1] * right_area[b + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    int mid;
+    if (best_axis >= 0 && best_cost < count * area(lo, hi)) {
+        float extent = c_hi[best_axis] - c_lo[best_axis];
+        auto it = std::partition(refs.begin() + first, refs.begin() + first + count, [&](int t) {
+            int b = std::min(sah_bins - 1, (int)((centroids[t][best_axis] - c_lo[best_axis]) / extent * sah_bins));
+            return b <= best_split;
+        });
+        mid = it - refs.begin();
+    } else if (count <= 4 * max_leaf_size) {
+        return; // Splitting would not pay off
+    } else {
+        // Every centroid is in the same place, so split by count instead
+        mid = first + count / 2;
+    }
+
+    int children = allocate_nodes(2);
+    nodes[node].first = children;
+    nodes[node].count = 0;
+
+    int left_count = mid - first;
+    int right_count = count - left_count;
+    if (count > parallel_build_threshold) {
+        ThreadPool::get().parallel_for(0, 2, [&](int child) {
+            if (child == 0) build(children, first, left_count, refs, bounds_min, bounds_max, centroids, depth + 1);
+            else build(children + 1, mid, right_count, refs, bounds_min, bounds_max, centroids, depth + 1);
+        });
+    } else {
+        build(children, first, left_count, refs, bounds_min, bounds_max, centroids, depth + 1);
+        build(children + 1, mid, right_count, refs, bounds_min, bounds_max, centroids, depth + 1);
+    }
+}
+
+/**
+ * Reserve consecutive slots in the node array. Safe to call from several building threads at once.
+ * 
+ * @param count Number of nodes to reserve
+ * @return Index of the first reserved node
+ */
+int BVH::allocate_nodes(int count) {
+    return std::atomic_ref<int>(node_count).fetch_add(count);
+}
+
+/**
+ * Copy the corners of every triangle into leaf order so that traversals read them sequentially.
+ */
+void BVH::gather_triangles(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+    triangles.resize(3 * triangle_order.size());
+    for (size_t t = 0; t < triangle_order.size(); t++) {
+        triangles[3 * t + 0] = positions[indices[3 * triangle_order[t] + 0]];
+        triangles[3 * t + 1] = positions[indices[3 * triangle_order[t] + 1]];
+        triangles[3 * t + 2] = positions[indices[3 * triangle_order[t] + 2]];
+    }
+}
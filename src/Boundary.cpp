@@ -3,15 +3,15 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <tiny_obj_loader.h>
-#define VOXELIZER_IMPLEMENTATION
-#include <voxelizer/voxelizer.h>
 #include <nfd.h>
 
 #include "Simulator.hpp"
 #include "Boundary.hpp"
 #include "OrbitalCamera.hpp"
+#include "ThreadPool.hpp"
+#include "MeshCache.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 using namespace RD3D;
@@ -32,6 +32,8 @@ void Boundary::import_boundary_mesh() {
     if (outPath != NULL) {
         boundary_mesh = std::make_unique<Mesh>(outPath);
         boundary_obj_path = outPath;
+        boundary_voxelized = false;
+        build_boundary_structures();
     }
 }
 
@@ -40,92 +42,125 @@ void Boundary::import_boundary_mesh() {
  */
 void Boundary::clear_boundary_mesh() {
     boundary_mesh = nullptr;
+    boundary_sdf = nullptr;
+    boundary_bvh = nullptr;
     boundary_obj_path = "";
+    boundary_voxelized = false;
 }
 
 /**
  * Uses the currently loaded boundary mesh to place corresponding boundary values in the grid.
- * This will also erase all current boundary values and reset the simulation.
+ * This will also erase all current boundary values, but leaves the running simulation untouched.
  */
 void Boundary::voxelize_boundary() {
-	if (boundary_obj_path.empty()) return;
-	clear_boundary();
+	if (!boundary_sdf) return;
+	boundary_voxelized = true;
 
-    tinyobj::ObjReader reader;
-    tinyobj::ObjReaderConfig reader_config;
+	brick_states.clear();
+	update_boundary_bricks();
+}
 
-    if (!reader.ParseFromFile(boundary_obj_path.c_str(), reader_config)) {
-        if (!reader.Error().empty())
-            std::cerr << "[ERROR] TinyObjReader: " << reader.Error();
-        exit(1);
-    }
+/**
+ * Bring the boundary values in the grid up to date with the current transform of the boundary mesh.
+ * Bricks that no part of the mesh passes through are entirely inside or outside of it, which a single ray parity
+ * test decides, and are skipped if that has not changed since the last update. Every other brick casts one ray per
+ * row to find which cells are inside of the mesh and looks up how far each cell is from the surface in the signed
+ * distance field, so that cells the mesh only partially covers receive a fractional boundary value.
+ */
+void Boundary::update_boundary_bricks() {
+	int res = simulator->grid_resolution;
+	int half = res / 2;
+	int bricks = simulator->bricks_per_axis;
+	if (brick_states.size() != (size_t)bricks * bricks * bricks) brick_states = std::vector<BrickState>((size_t)bricks * bricks * bricks, BrickState::Unknown);
+
+	// Cells closer to the surface than this (in grid cells) receive a nonzero boundary value even when outside of the mesh
+	float band = fill_interior ? 0.5f : 1.5f;
+	float local_band = band / (res * boundary_scale);
+
+	auto to_local = [&](glm::vec3 cell) {
+		glm::vec3 world = (cell - glm::vec3(half) + 0.5f) / (float)res;
+		return (world - boundary_offset) / boundary_scale;
+	};
 
-    auto& attrib = reader.GetAttrib();
-    auto& shapes = reader.GetShapes();
-	float res = 1.0 / simulator->grid_resolution;
-	float precision = 0.01;
-	vx_point_cloud_t* voxels;
-
-    for (int s = 0; s < shapes.size(); s++) {
-        vx_mesh_t* mesh = vx_mesh_alloc(shapes[s].mesh.num_face_vertices.size(), shapes[s].mesh.indices.size());
-
-		for (int v = 0; v < attrib.vertices.size() / 3; v++) {
-			glm::vec3 vertex = glm::vec3(
-				attrib.vertices[3 * size_t(v) + 0],
-				attrib.vertices[3 * size_t(v) + 1],
-				attrib.vertices[3 * size_t(v) + 2]
-			);
-
-			mesh->vertices[v].x = vertex.x;
-			mesh->vertices[v].y = vertex.y;
-			mesh->vertices[v].z = vertex.z;
+	fill_boundary_bricks([&](glm::ivec3 min_cell, glm::ivec3 size, float* values) {
+		int brick = min_cell.x / Simulator::brick_size + bricks * (min_cell.y / Simulator::brick_size + bricks * (min_cell.z / Simulator::brick_size));
+		int cell_count = size.x * size.y * size.z;
+
+		glm::vec3 lo = to_local(glm::vec3(min_cell)) - glm::vec3(local_band);
+		glm::vec3 hi = to_local(glm::vec3(min_cell + size) - 1.0f) + glm::vec3(local_band);
+
+		if (boundary_scale <= 0.0f || !boundary_bvh->overlaps_box(lo, hi)) {
+			BrickState state = BrickState::Empty;
+			if (boundary_scale > 0.0f && fill_interior && boundary_bvh->is_inside(0.5f * (lo + hi))) state = BrickState::Full;
+			if (brick_states[brick] == state) return false;
+
+			brick_states[brick] = state;
+			std::fill(values, values + cell_count, state == BrickState::Full ? 1.0f : 0.0f);
+			return true;
 		}
 
-        for (size_t f = 0; f < shapes[s].mesh.indices.size(); f++) {
-            mesh->indices[f] = shapes[s].mesh.indices[f].vertex_index;
-        }
+		brick_states[brick] = BrickState::Surface;
+		std::vector<float> crossings;
 
-		voxels = vx_voxelize_pc(mesh, 1.0 / simulator->grid_resolution, 1.0 / simulator->grid_resolution, 1.0 / simulator->grid_resolution, 1.0 / simulator->grid_resolution / 10.0);
-		break;
-	}
+		for (int z = 0; z < size.z; z++) {
+			for (int y = 0; y < size.y; y++) {
+				glm::vec3 row_start = to_local(glm::vec3(min_cell.x, min_cell.y + y, min_cell.z + z));
+				crossings.clear();
+				if (fill_interior) {
+					boundary_bvh->x_ray_crossings(row_start.y, row_start.z, row_start.x, crossings);
+					std::sort(crossings.begin(), crossings.end());
+				}
 
-	for (int i = 0; i < voxels->nvertices; i++) {
-		int x = ((int)((boundary_scale * voxels->vertices[i].x + boundary_offset.x) * simulator->grid_resolution)) + (simulator->grid_resolution / 2);
-		int y = ((int)((boundary_scale * voxels->vertices[i].y + boundary_offset.y) * simulator->grid_resolution)) + (simulator->grid_resolution / 2);
-		int z = ((int)((boundary_scale * voxels->vertices[i].z + boundary_offset.z) * simulator->grid_resolution)) + (simulator->grid_resolution / 2);
+				size_t next_crossing = 0;
+				for (int x = 0; x < size.x; x++) {
+					glm::vec3 local = to_local(glm::vec3(min_cell.x + x, min_cell.y + y, min_cell.z + z));
+					float d = std::abs(boundary_sdf->sample(local)) * boundary_scale * res; // Distance in grid cells
+					float& value = values[x + size.x * (y + size.y * z)];
 
-		if (x >= 0 && x < simulator->grid_resolution && y >= 0 && y < simulator->grid_resolution && z >= 0 && z < simulator->grid_resolution) {
-			int idx = x + y * simulator->grid_resolution + z * (simulator->grid_resolution * simulator->grid_resolution);
-			simulator->grid[4 * idx + 2] = 1.0;
+					if (!fill_interior) {
+						value = std::clamp(band - d, 0.0f, 1.0f);
+						continue;
+					}
+
+					// An odd number of crossings further along the row means the cell is inside of the mesh
+					while (next_crossing < crossings.size() && crossings[next_crossing] < local.x) next_crossing++;
+					bool inside = (crossings.size() - next_crossing) % 2 == 1;
+					value = std::clamp(inside ? band + d : band - d, 0.0f, 1.0f);
+				}
+			}
 		}
-	}
 
-	simulator->load_data_to_texture();	
+		return true;
+	});
 }
 
 /**
  * Clears all of the boundary values from the grid.
  */
 void Boundary::clear_boundary() {
+	brick_states.clear();
 	for (int i = 0; i < simulator->grid_resolution; i++) {
 		for (int j = 0; j < simulator->grid_resolution; j++) {
 			for (int k = 0; k < simulator->grid_resolution; k++) {
-				size_t idx = 4 * (i + j * simulator->grid_resolution + k * (simulator->grid_resolution * simulator->grid_resolution)) + 2;
-				simulator->grid[idx] = 0.0f; // Reset only the boundary component of the 3D grid
+				size_t idx = i + j * simulator->grid_resolution + k * (simulator->grid_resolution * simulator->grid_resolution);
+				if (simulator->boundary_grid[idx] == 0.0f) continue;
+				simulator->boundary_grid[idx] = 0.0f;
+				simulator->mark_dirty(i, j, k);
 			}
 		}
 	}	
 
-	simulator->load_data_to_texture();
+	simulator->load_boundary_to_texture();
 }
 
 /**
  * Thickens the boundary values in all directions.
  */
 void Boundary::thicken_boundary() {
+	brick_states.clear();
 	auto get_grid_cell = [](Simulator* sim, int x, int y, int z){
-		size_t idx = 4 * (z + y * sim->grid_resolution + x * (sim->grid_resolution * sim->grid_resolution)) + 2;
-		return &sim->grid[idx];
+		size_t idx = z + y * sim->grid_resolution + x * (sim->grid_resolution * sim->grid_resolution);
+		return &sim->boundary_grid[idx];
 	};
 
 	int dx[3] = {-1, 0, 1};
@@ -135,8 +170,7 @@ void Boundary::thicken_boundary() {
 	for (int i = 0; i < simulator->grid_resolution; i++) {
 		for (int j = 0; j < simulator->grid_resolution; j++) {
 			for (int k = 0; k < simulator->grid_resolution; k++) {
-				size_t idx = 4 * (i + j * simulator->grid_resolution + k * (simulator->grid_resolution * simulator->grid_resolution)) + 2;
-				if (*get_grid_cell(simulator, k, j, i) == 1.0f) {
+				if (*get_grid_cell(simulator, k, j, i) >= 1.0f) {
 					for (int a = 0; a < 3; a++) {
 						for (int b = 0; b < 3; b++) {
 							for (int c = 0; c < 3; c++) {
@@ -146,7 +180,7 @@ void Boundary::thicken_boundary() {
 
 								if (nx >= 0 && nx < simulator->grid_resolution && ny >= 0 && ny < simulator->grid_resolution && nz >= 0 && nz < simulator->grid_resolution) {
 									auto p = get_grid_cell(simulator, nx, ny, nz);	
-									if (*p == 0.0f) *p = 0.5f;
+									if (*p < 1.0f) *p = -1.0f;
 								}
 							}
 						}
@@ -160,34 +194,177 @@ void Boundary::thicken_boundary() {
 		for (int j = 0; j < simulator->grid_resolution; j++) {
 			for (int k = 0; k < simulator->grid_resolution; k++) {
 				auto p = get_grid_cell(simulator, k, j, i);
-				if (*p == 0.5f) *p = 1.0f;	
+				if (*p == -1.0f) {
+					*p = 1.0f;
+					simulator->mark_dirty(i, j, k);
+				}
 			}
 		}
 	}	
 
-	simulator->load_data_to_texture();
+	simulator->load_boundary_to_texture();
 }
 
 /**
  * Turns all boundary value cells into empty cells and vice versa.
  */
 void Boundary::invert_boundary() {
+	brick_states.clear();
 	auto get_grid_cell = [](Simulator* sim, int x, int y, int z){
-		size_t idx = 4 * (z + y * sim->grid_resolution + x * (sim->grid_resolution * sim->grid_resolution)) + 2;
-		return &sim->grid[idx];
+		size_t idx = z + y * sim->grid_resolution + x * (sim->grid_resolution * sim->grid_resolution);
+		return &sim->boundary_grid[idx];
 	};
 
 	for (int i = 0; i < simulator->grid_resolution; i++) {
 		for (int j = 0; j < simulator->grid_resolution; j++) {
 			for (int k = 0; k < simulator->grid_resolution; k++) {
 				auto p = get_grid_cell(simulator, k, j, i);
-				if (*p == 1.0f) *p = 0.0f;	
-				else *p = 1.0f;
+				*p = 1.0f - *p;
 			}
 		}
 	}	
 
-	simulator->load_data_to_texture();
+	simulator->mark_all_dirty();
+	simulator->load_boundary_to_texture();
+}
+
+/**
+ * Loads the triangles of the boundary mesh and builds their signed distance field and BVH in the mesh's local space.
+ */
+void Boundary::build_boundary_structures() {
+	CachedMesh mesh;
+	std::string error;
+
+	if (!load_cached_mesh(boundary_obj_path, mesh, error)) {
+		std::cerr << "[ERROR] ObjLoader: " << error;
+		exit(1);
+	}
+
+	std::vector<glm::vec3> positions = mesh.get_positions();
+	boundary_sdf = std::make_unique<SignedDistanceField>(positions, mesh.indices, sdf_resolution);
+
+	// The BVH is stored in the mesh's cache the first time it is built
+	if (!mesh.bvh_nodes.empty()) {
+		boundary_bvh = std::make_unique<BVH>(positions, mesh.indices, std::move(mesh.bvh_nodes), std::move(mesh.bvh_triangle_order));
+	} else {
+		boundary_bvh = std::make_unique<BVH>(positions, mesh.indices);
+		mesh.bvh_nodes = boundary_bvh->get_nodes();
+		mesh.bvh_triangle_order = boundary_bvh->get_triangle_order();
+		write_mesh_cache(boundary_obj_path, mesh);
+	}
+
+	brick_states.clear();
+}
+
+/**
+ * Overwrite the boundary values of the grid in parallel over bricks and upload the bricks that changed.
+ * 
+ * @param evaluate_brick Function that fills the values of the brick with the given minimum cell and size (x-major),
+ *                       returning false if the brick can be left as it is
+ */
+void Boundary::fill_boundary_bricks(const std::function<bool(glm::ivec3, glm::ivec3, float*)>& evaluate_brick) {
+	int res = simulator->grid_resolution;
+	int bricks = simulator->bricks_per_axis;
+
+	ThreadPool::get().parallel_for(0, bricks * bricks * bricks, [&](int brick) {
+		glm::ivec3 min_cell = Simulator::brick_size * glm::ivec3(brick % bricks, (brick / bricks) % bricks, brick / (bricks * bricks));
+		glm::ivec3 size = glm::min(glm::ivec3(Simulator::brick_size), glm::ivec3(res) - min_cell);
+
+		std::vector<float> values(size.x * size.y * size.z);
+		if (!evaluate_brick(min_cell, size, values.data())) return;
+
+		bool changed = false;
+		for (int z = 0; z < size.z; z++) {
+			for (int y = 0; y < size.y; y++) {
+				for (int x = 0; x < size.x; x++) {
+					size_t idx = (min_cell.x + x) + (min_cell.y + y) * res + (size_t)(min_cell.z + z) * res * res;
+					float value = values[x + size.x * (y + size.y * z)];
+					if (simulator->boundary_grid[idx] == value) continue;
+					simulator->boundary_grid[idx] = value;
+					changed = true;
+				}
+			}
+		}
+
+		// Bricks are disjoint, so every thread flags a different brick
+		if (changed) simulator->mark_dirty(min_cell.x, min_cell.y, min_cell.z);
+	});
+
+	simulator->load_boundary_to_texture();
+}
+
+/**
+ * Evaluates the tree of implicit primitives straight into the boundary values of the grid, replacing the current ones.
+ * Bricks whose center is far enough from the surface, given how quickly the tree's distance can change, are filled
+ * as a whole; every other brick is evaluated a row at a time, with cells along the surface receiving fractional values.
+ */
+void Boundary::apply_primitives() {
+	if (csg_primitives.empty()) return;
+
+	std::unique_ptr<CSGNode> root = build_csg_tree();
+	float bound = root->lipschitz_bound();
+	boundary_voxelized = false;
+	brick_states.clear();
+
+	int res = simulator->grid_resolution;
+	int half = res / 2;
+	float cell = 1.0f / res;
+
+	fill_boundary_bricks([&](glm::ivec3 min_cell, glm::ivec3 size, float* values) {
+		glm::vec3 lo = (glm::vec3(min_cell - half) + 0.5f) * cell;
+		glm::vec3 hi = (glm::vec3(min_cell + size - half) - 0.5f) * cell;
+		float radius = 0.5f * glm::length(hi - lo) * bound * res; // In grid cells
+		float d = root->evaluate(0.5f * (lo + hi)) * res;
+		int cell_count = size.x * size.y * size.z;
+
+		// Only cells within half a cell of the surface receive a fractional value
+		if (d - radius >= 0.5f) {
+			std::fill(values, values + cell_count, 0.0f);
+			return true;
+		}
+		if (d + radius <= -0.5f) {
+			std::fill(values, values + cell_count, 1.0f);
+			return true;
+		}
+
+		for (int z = 0; z < size.z; z++) {
+			for (int y = 0; y < size.y; y++) {
+				float* row = values + size.x * (y + size.y * z);
+				root->evaluate_row(lo.x, cell, lo.y + y * cell, lo.z + z * cell, size.x, row);
+				for (int x = 0; x < size.x; x++)
+					row[x] = std::clamp(0.5f - row[x] * res, 0.0f, 1.0f);
+			}
+		}
+
+		return true;
+	});
+}
+
+/**
+ * Combines the primitives into a tree, each one applied with its operation to the tree of the primitives before it.
+ */
+std::unique_ptr<CSGNode> Boundary::build_csg_tree() {
+	std::unique_ptr<CSGNode> root;
+
+	for (auto& primitive : csg_primitives) {
+		auto leaf = std::make_unique<CSGNode>();
+		leaf->type = primitive.type;
+		leaf->center = primitive.center;
+		leaf->size = primitive.size;
+
+		if (!root) {
+			root = std::move(leaf);
+			continue;
+		}
+
+		auto node = std::make_unique<CSGNode>();
+		node->type = primitive.operation;
+		node->left = std::move(root);
+		node->right = std::move(leaf);
+		root = std::move(node);
+	}
+
+	return root;
 }
 
 /**
@@ -240,17 +417,79 @@ void Boundary::draw_gui() {
 	ImGui::SameLine();
 	if (ImGui::Button("Voxelize")) voxelize_boundary();
 	ImGui::SameLine();
+	bool transform_changed = false;
 	if (ImGui::Button("Reset Transforms")) {
 		boundary_offset = glm::vec3(0.0f, 0.0f, 0.0f);
 		boundary_scale = 1.0f;
+		transform_changed = true;
 	}
 	if (ImGui::Button("Thicken")) thicken_boundary();
 	ImGui::SameLine();
 	if (ImGui::Button("Invert")) invert_boundary();
+	ImGui::SameLine();
+	if (ImGui::Checkbox("Fill Interior", &fill_interior) && boundary_voxelized) voxelize_boundary();
+
+	transform_changed |= ImGui::SliderFloat3("Mesh Offset", glm::value_ptr(boundary_offset), -1.0f, 1.0f);
+	transform_changed |= ImGui::SliderFloat("Mesh Scale", &boundary_scale, 0.0f, 2.0f);
 
-	ImGui::SliderFloat3("Mesh Offset", glm::value_ptr(boundary_offset), -1.0f, 1.0f);
-	ImGui::SliderFloat("Mesh Scale", &boundary_scale, 0.0f, 2.0f);
+	// Once voxelized, the boundary follows the mesh while it is being transformed
+	if (transform_changed && boundary_voxelized) update_boundary_bricks();
+
+	draw_primitives_gui();
 
 	ImGui::SliderFloat("Grid Cube Opacity", &grid_cube_opacity, 0.0f, 1.0f);
 	ImGui::SliderFloat("Boundary Mesh Opacity", &boundary_mesh_opacity, 0.0f, 1.0f);
-}
\ No newline at end of file
+}
+
+/**
+ * Draw the GUI section that allows for building a boundary out of implicit primitives.
+ */
+void Boundary::draw_primitives_gui() {
+	if (!ImGui::TreeNode("Primitives")) return;
+
+	const char* primitive_names[] = {"Sphere", "Box", "Cylinder", "Torus", "Gyroid", "Plane"};
+	const char* operation_names[] = {"Union", "Intersection", "Difference"};
+	bool changed = false;
+
+	for (size_t i = 0; i < csg_primitives.size(); i++) {
+		CSGPrimitive& primitive = csg_primitives[i];
+		ImGui::PushID((int)i);
+
+		if (i > 0) {
+			int operation = (int)primitive.operation - (int)CSGType::Union;
+			if (ImGui::Combo("Operation", &operation, operation_names, 3)) {
+				primitive.operation = (CSGType)(operation + (int)CSGType::Union);
+				changed = true;
+			}
+		}
+
+		int type = (int)primitive.type;
+		if (ImGui::Combo("Primitive", &type, primitive_names, 6)) {
+			primitive.type = (CSGType)type;
+			changed = true;
+		}
+		changed |= ImGui::DragFloat3("Center", glm::value_ptr(primitive.center), 0.005f, -1.0f, 1.0f);
+		changed |= ImGui::DragFloat3("Size", glm::value_ptr(primitive.size), 0.005f, -1.0f, 1.0f);
+
+		if (ImGui::Button("Remove")) {
+			csg_primitives.erase(csg_primitives.begin() + i);
+			changed = true;
+		}
+
+		ImGui::Separator();
+		ImGui::PopID();
+	}
+
+	if (ImGui::Button("Add Primitive")) {
+		csg_primitives.push_back(CSGPrimitive());
+		changed = true;
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Apply")) apply_primitives();
+	ImGui::SameLine();
+	ImGui::Checkbox("Live", &csg_live);
+
+	if (changed && csg_live) apply_primitives();
+
+	ImGui::TreePop();
+}
@@ -0,0 +1,133 @@
+#include "CSG.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace RD3D;
+
+static constexpr float two_pi = 6.28318530718f;
+
+// Shortest gyroid period, which keeps a zero or negative period from producing infinite distances
+static constexpr float min_gyroid_period = 1e-3f;
+
+// Rows are evaluated in chunks so that the children of inner nodes can use fixed size scratch buffers
+static constexpr int row_chunk = 64;
+
+/**
+ * Evaluate the signed distance of the tree at a single point.
+ * 
+ * @param p The point to evaluate at
+ */
+float CSGNode::evaluate(glm::vec3 p) const {
+    float d;
+    evaluate_row(p.x, 0.0f, p.y, p.z, 1, &d);
+    return d;
+}
+
+/**
+ * Evaluate the signed distance of the tree at n evenly spaced points along the x axis. The loops of every
+ * primitive are branch free over the row, which lets the compiler vectorize them.
+ * 
+ * @param x0 The x coordinate of the first point
+ * @param dx The spacing between points
+ * @param y The y coordinate of the row
+ * @param z The z coordinate of the row
+ * @param n The number of points
+ * @param out Array of n distances to write to
+ */
+void CSGNode::evaluate_row(float x0, float dx, float y, float z, int n, float* out) const {
+    if (n > row_chunk) {
+        for (int start = 0; start < n; start += row_chunk)
+            evaluate_row(x0 + start * dx, dx, y, z, std::min(row_chunk, n - start), out + start);
+        return;
+    }
+
+    float py = y - center.y;
+    float pz = z - center.z;
+    float ox = x0 - center.x;
+
+    switch (type) {
+    case CSGType::Sphere:
+        for (int i = 0; i < n; i++) {
+            float px = ox + i * dx;
+            out[i] = std::sqrt(px * px + py * py + pz * pz) - size.x;
+        }
+        break;
+    case CSGType::Box: {
+        float qy = std::abs(py) - size.y;
+        float qz = std::abs(pz) - size.z;
+        for (int i = 0; i < n; i++) {
+            float qx = std::abs(ox + i * dx) - size.x;
+            float mx = std::max(qx, 0.0f), my = std::max(qy, 0.0f), mz = std::max(qz, 0.0f);
+            out[i] = std::sqrt(mx * mx + my * my + mz * mz) + std::min(std::max(qx, std::max(qy, qz)), 0.0f);
+        }
+        break;
+    }
+    case CSGType::Cylinder: {
+        float qy = std::abs(py) - size.y;
+        for (int i = 0; i < n; i++) {
+            float px = ox + i * dx;
+            float qr = std::sqrt(px * px + pz * pz) - size.x;
+            float mr = std::max(qr, 0.0f), my = std::max(qy, 0.0f);
+            out[i] = std::sqrt(mr * mr + my * my) + std::min(std::max(qr, qy), 0.0f);
+        }
+        break;
+    }
+    case CSGType::Torus:
+        for (int i = 0; i < n; i++) {
+            float px = ox + i * dx;
+            float qr = std::sqrt(px * px + pz * pz) - size.x;
+            out[i] = std::sqrt(qr * qr + py * py) - size.y;
+        }
+        break;
+    case CSGType::Gyroid: {
+        // The gyroid function is not a true distance, so it is scaled to roughly one and its bound is widened to match
+        float k = two_pi / std::max(size.x, min_gyroid_period);
+        float sy = std::sin(k * py), cy = std::cos(k * py);
+        float sz = std::sin(k * pz), cz = std::cos(k * pz);
+        for (int i = 0; i < n; i++) {
+            float px = k * (ox + i * dx);
+            float g = std::sin(px) * cy + sy * cz + sz * std::cos(px);
+            out[i] = std::abs(g) / k - 0.5f * size.y;
+        }
+        break;
+    }
+    case CSGType::Plane: {
+        // A zero normal can't be normalized, so it falls back to +Y rather than filling the field with NaNs
+        float length = glm::length(size);
+        glm::vec3 normal = length > 0.0f ? size / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        for (int i = 0; i < n; i++)
+            out[i] = normal.x * (ox + i * dx) + normal.y * py + normal.z * pz;
+        break;
+    }
+    case CSGType::Union:
+    case CSGType::Intersection:
+    case CSGType::Difference: {
+        float other[row_chunk];
+        left->evaluate_row(x0, dx, y, z, n, out);
+        right->evaluate_row(x0, dx, y, z, n, other);
+        if (type == CSGType::Union) for (int i = 0; i < n; i++) out[i] = std::min(out[i], other[i]);
+        else if (type == CSGType::Intersection) for (int i = 0; i < n; i++) out[i] = std::max(out[i], other[i]);
+        else for (int i = 0; i < n; i++) out[i] = std::max(out[i], -other[i]);
+        break;
+    }
+    }
+}
+
+/**
+ * Get an upper bound on how quickly the distance of the tree can change per unit of distance.
+ * If the distance at the center of a box is larger than this times the box's half diagonal,
+ * the entire box is on the same side of the surface.
+ */
+float CSGNode::lipschitz_bound() const {
+    switch (type) {
+    case CSGType::Gyroid:
+        return 2.0f * std::sqrt(3.0f);
+    case CSGType::Union:
+    case CSGType::Intersection:
+    case CSGType::Difference:
+        return std::max(left->lipschitz_bound(), right->lipschitz_bound());
+    default:
+        return 1.0f;
+    }
+}
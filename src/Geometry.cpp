@@ -0,0 +1,94 @@
+#include "Geometry.hpp"
+
+using namespace RD3D;
+
+/**
+ * Determine on which side of the line through the origin and (x2, y2) the point (x1, y1) lies.
+ * Ties are broken consistently so that rays passing exactly through a shared edge or vertex are counted once.
+ */
+static int orientation(double x1, double y1, double x2, double y2, double& twice_signed_area) {
+    twice_signed_area = y1 * x2 - x1 * y2;
+    if (twice_signed_area > 0) return 1;
+    if (twice_signed_area < 0) return -1;
+    if (y2 > y1) return 1;
+    if (y2 < y1) return -1;
+    if (x1 > x2) return 1;
+    if (x1 < x2) return -1;
+    return 0;
+}
+
+/**
+ * Test whether the 2D point (x0, y0) lies in the triangle (x1, y1), (x2, y2), (x3, y3) and compute its barycentric coordinates.
+ * Points on an edge shared by two triangles are consistently assigned to exactly one of them, which keeps ray parity tests robust.
+ */
+bool RD3D::point_in_triangle_2d(double x0, double y0, double x1, double y1, double x2, double y2, double x3, double y3, double& a, double& b, double& c) {
+    x1 -= x0; x2 -= x0; x3 -= x0;
+    y1 -= y0; y2 -= y0; y3 -= y0;
+
+    int sign_a = orientation(x2, y2, x3, y3, a);
+    if (sign_a == 0) return false;
+    int sign_b = orientation(x3, y3, x1, y1, b);
+    if (sign_b != sign_a) return false;
+    int sign_c = orientation(x1, y1, x2, y2, c);
+    if (sign_c != sign_a) return false;
+
+    double sum = a + b + c;
+    if (sum == 0) return false;
+    a /= sum;
+    b /= sum;
+    c /= sum;
+    return true;
+}
+
+/**
+ * Find the point on a triangle that is closest to the given point.
+ * See Real-Time Collision Detection by Christer Ericson, section 5.1.5.
+ * 
+ * @param p The point to query
+ * @param a First corner of the triangle
+ * @param b Second corner of the triangle
+ * @param c Third corner of the triangle
+ */
+glm::vec3 RD3D::closest_point_on_triangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+/**
+ * Find the unsigned distance between a point and a triangle.
+ * 
+ * @param p The point to query
+ * @param a First corner of the triangle
+ * @param b Second corner of the triangle
+ * @param c Third corner of the triangle
+ */
+float RD3D::point_triangle_distance(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+    return glm::length(p - closest_point_on_triangle(p, a, b, c));
+}
@@ -0,0 +1,92 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace RD3D;
+
+/**
+ * Map the file at the given path into memory. Check is_open() to find out whether this succeeded.
+ * 
+ * @param path File path to the file to map
+ */
+MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        file_handle = nullptr;
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size)) return;
+    length = (size_t)file_size.QuadPart;
+    open = true;
+    if (length == 0) return;
+
+    mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_handle == NULL) {
+        open = false;
+        return;
+    }
+    contents = (const char*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    open = contents != nullptr;
+#else
+    file_descriptor = ::open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) return;
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0) return;
+    length = (size_t)file_stat.st_size;
+    open = true;
+    if (length == 0) return;
+
+    void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    if (mapping == MAP_FAILED) {
+        open = false;
+        return;
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    contents = (const char*)mapping;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (contents) UnmapViewOfFile(contents);
+    if (mapping_handle) CloseHandle(mapping_handle);
+    if (file_handle) CloseHandle(file_handle);
+#else
+    if (contents) munmap((void*)contents, length);
+    if (file_descriptor >= 0) close(file_descriptor);
+#endif
+}
+
+/**
+ * Whether the file was successfully opened and mapped.
+ */
+bool MappedFile::is_open() const {
+    return open;
+}
+
+/**
+ * Get a pointer to the start of the file's contents, which is null for empty files.
+ */
+const char* MappedFile::data() const {
+    return contents;
+}
+
+/**
+ * Get the size of the file in bytes.
+ */
+size_t MappedFile::size() const {
+    return length;
+}
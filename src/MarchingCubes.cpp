@@ -0,0 +1,385 @@
+#include "MarchingCubes.hpp"
+#include "MarchingCubesTables.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+using namespace RD3D;
+
+// Offsets of the corners of a cell, in the same order as the Marching Cubes Shader
+static constexpr int corner_offsets[8][3] = {
+    {0, 0, 0}, {0, 0, 1}, {1, 0, 1}, {1, 0, 0},
+    {0, 1, 0}, {0, 1, 1}, {1, 1, 1}, {1, 1, 0}
+};
+
+// Each edge of a cell is owned by the corner it starts from, as {x, y, z, axis} with x = 0, y = 1 and z = 2
+static constexpr int edge_owners[12][4] = {
+    {0, 0, 0, 2}, {0, 0, 1, 0}, {1, 0, 0, 2}, {0, 0, 0, 0},
+    {0, 1, 0, 2}, {0, 1, 1, 0}, {1, 1, 0, 2}, {0, 1, 0, 0},
+    {0, 0, 0, 1}, {0, 0, 1, 1}, {1, 0, 1, 1}, {1, 0, 0, 1}
+};
+
+/**
+ * Get the number of triangles that each cube index produces.
+ */
+static const std::array<int, 256>& triangle_counts() {
+    static std::array<int, 256> counts = []() {
+        std::array<int, 256> counts;
+        for (int c = 0; c < 256; c++) {
+            counts[c] = 0;
+            while (counts[c] < 5 && triangle_table[c * 16 + counts[c] * 3] != -1) counts[c]++;
+        }
+        return counts;
+    }();
+    return counts;
+}
+
+/**
+ * Compute the gradient of the field at every grid point from central differences between neighbouring points,
+ * falling back to one-sided differences on the edges of the grid. Extractors compute it once per point and share
+ * it between all of the point's edges or cells.
+ * 
+ * @param field resolution^3 samples of the scalar field, x-major
+ * @param resolution The number of samples along each axis
+ * @param step The number of samples between neighbouring grid points
+ * @return The gradient at each of the ((resolution - 1) / step + 1)^3 grid points, x-major
+ */
+std::vector<glm::vec3> RD3D::compute_gradients(const std::vector<float>& field, int resolution, int step) {
+    int points = (resolution - 1) / step + 1;
+    auto sample = [&](int x, int y, int z) {
+        return field[x * step + resolution * (y * step + (size_t)resolution * z * step)];
+    };
+
+    std::vector<glm::vec3> gradients((size_t)points * points * points);
+    ThreadPool::get().parallel_for(0, points, [&](int z) {
+        int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, points - 1);
+        for (int y = 0; y < points; y++) {
+            int y0 = std::max(y - 1, 0), y1 = std::min(y + 1, points - 1);
+            for (int x = 0; x < points; x++) {
+                int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, points - 1);
+                gradients[x + points * (y + (size_t)points * z)] = glm::vec3(
+                    (sample(x1, y, z) - sample(x0, y, z)) / (x1 - x0),
+                    (sample(x, y1, z) - sample(x, y0, z)) / (y1 - y0),
+                    (sample(x, y, z1) - sample(x, y, z0)) / (z1 - z0)
+                );
+            }
+        }
+    });
+    return gradients;
+}
+
+/**
+ * Triangulate a scalar field on the CPU with Marching Cubes. Every grid edge belongs to the sample it starts from,
+ * so each edge crossing the surface produces exactly one vertex which all of the neighbouring cells index into.
+ * 
+ * Work is split in parallel over z-slabs, first to count the vertices and triangles of every slab and then, once
+ * the counts are prefix summed into offsets, to write each slab's vertices and indices straight into its range
+ * of exactly sized arrays.
+ * 
+ * Every sample is treated as the center of a grid cell, so positions are in texture coordinates like the
+ * Marching Cubes Shader's output, and normals point away from the region above the threshold.
+ * 
+ * @param field resolution^3 samples of the scalar field, x-major
+ * @param resolution The number of samples along each axis
+ * @param threshold The value of the field at the surface
+ * @param step The number of samples spanned by each edge of a cell, where larger steps give coarser meshes
+ * @return The welded mesh, with three indices per triangle
+ */
+MarchingCubesMesh RD3D::marching_cubes(const std::vector<float>& field, int resolution, float threshold, int step) {
+    int points = (resolution - 1) / step + 1;
+    int cells = points - 1;
+    if (cells <= 0) return {};
+
+    const std::array<int, 256>& counts = triangle_counts();
+    auto sample = [&](int x, int y, int z) {
+        return field[x * step + resolution * (y * step + (size_t)resolution * z * step)];
+    };
+    auto inside = [&](int x, int y, int z) {
+        return sample(x, y, z) < threshold;
+    };
+    auto edge_mask = [&](int x, int y, int z) {
+        bool from = inside(x, y, z);
+        int mask = 0;
+        if (x < cells && inside(x + 1, y, z) != from) mask |= 1;
+        if (y < cells && inside(x, y + 1, z) != from) mask |= 2;
+        if (z < cells && inside(x, y, z + 1) != from) mask |= 4;
+        return mask;
+    };
+
+    // Where the surface crosses one of a cell's edges, in grid points
+    auto edge_crossing = [&](int x, int y, int z, int edge) {
+        const int* owner = edge_owners[edge];
+        glm::ivec3 a(x + owner[0], y + owner[1], z + owner[2]);
+        glm::ivec3 b = a;
+        b[owner[3]]++;
+
+        float va = sample(a.x, a.y, a.z);
+        float vb = sample(b.x, b.y, b.z);
+        return glm::mix(glm::vec3(a), glm::vec3(b), (threshold - va) / (vb - va));
+    };
+
+    // Pass 1: number the vertices of each sample's edges within its slab, and classify and count the triangles of each cell.
+    // Triangles whose corners coincide or fall on a line, where the surface passes through a sample, are left out
+    std::vector<uint32_t> first_vertex((size_t)points * points * points);
+    std::vector<uint8_t> cube_indices((size_t)cells * cells * cells);
+    std::vector<uint8_t> kept_triangles((size_t)cells * cells * cells);
+    std::vector<size_t> slab_vertices(points + 1, 0);
+    std::vector<size_t> slab_triangles(points + 1, 0);
+
+    ThreadPool::get().parallel_for(0, points, [&](int z) {
+        uint32_t vertices = 0;
+        for (int y = 0; y < points; y++) {
+            for (int x = 0; x < points; x++) {
+                first_vertex[x + points * (y + (size_t)points * z)] = vertices;
+                vertices += std::popcount((unsigned int)edge_mask(x, y, z));
+            }
+        }
+        slab_vertices[z + 1] = vertices;
+        if (z == cells) return;
+
+        size_t triangles = 0;
+        for (int y = 0; y < cells; y++) {
+            for (int x = 0; x < cells; x++) {
+                int cube_index = 0;
+                for (int i = 0; i < 8; i++)
+                    if (inside(x + corner_offsets[i][0], y + corner_offsets[i][1], z + corner_offsets[i][2])) cube_index |= (1 << i);
+
+                int kept = 0;
+                for (int i = 0; i < counts[cube_index]; i++) {
+                    const int* edges = &triangle_table[cube_index * 16 + i * 3];
+                    glm::vec3 a = edge_crossing(x, y, z, edges[0]);
+                    glm::vec3 n = glm::cross(edge_crossing(x, y, z, edges[1]) - a, edge_crossing(x, y, z, edges[2]) - a);
+                    if (glm::dot(n, n) > 1e-12f) {
+                        kept |= 1 << i;
+                        triangles++;
+                    }
+                }
+
+                cube_indices[x + cells * (y + (size_t)cells * z)] = cube_index;
+                kept_triangles[x + cells * (y + (size_t)cells * z)] = kept;
+            }
+        }
+        slab_triangles[z + 1] = triangles;
+    });
+
+    for (int z = 0; z < points; z++) {
+        slab_vertices[z + 1] += slab_vertices[z];
+        slab_triangles[z + 1] += slab_triangles[z];
+    }
+
+    // Pass 2: write the vertices of each slab and the triangles indexing them into their ranges of the output
+    MarchingCubesMesh mesh;
+    mesh.vertices.resize(slab_vertices[points]);
+    mesh.indices.resize(3 * slab_triangles[points]);
+    float cell_size = 1.0f / resolution;
+
+    std::vector<glm::vec3> gradients = compute_gradients(field, resolution, step);
+    auto gradient = [&](const glm::ivec3& point) {
+        return gradients[point.x + points * (point.y + (size_t)points * point.z)];
+    };
+
+    ThreadPool::get().parallel_for(0, points, [&](int z) {
+        size_t out = slab_vertices[z];
+        for (int y = 0; y < points; y++) {
+            for (int x = 0; x < points; x++) {
+                int mask = edge_mask(x, y, z);
+                for (int axis = 0; axis < 3; axis++) {
+                    if (((mask >> axis) & 1) == 0) continue;
+
+                    glm::ivec3 a(x, y, z);
+                    glm::ivec3 b = a;
+                    b[axis]++;
+
+                    float va = sample(a.x, a.y, a.z);
+                    float vb = sample(b.x, b.y, b.z);
+                    float t = (threshold - va) / (vb - va);
+
+                    mesh.vertices[out].pos = (glm::mix(glm::vec3(a), glm::vec3(b), t) * (float)step + 0.5f) * cell_size;
+
+                    glm::vec3 n = glm::mix(gradient(a), gradient(b), t);
+                    float length = glm::length(n);
+                    mesh.vertices[out].normal = length > 0.0f ? -n / length : glm::vec3(0.0f);
+                    out++;
+                }
+            }
+        }
+        if (z == cells) return;
+
+        out = 3 * slab_triangles[z];
+        for (int y = 0; y < cells; y++) {
+            for (int x = 0; x < cells; x++) {
+                int cube_index = cube_indices[x + cells * (y + (size_t)cells * z)];
+                int kept = kept_triangles[x + cells * (y + (size_t)cells * z)];
+
+                for (int i = 0; i < 3 * counts[cube_index]; i++) {
+                    if (((kept >> (i / 3)) & 1) == 0) continue;
+
+                    const int* owner = edge_owners[triangle_table[cube_index * 16 + i]];
+                    int ox = x + owner[0], oy = y + owner[1], oz = z + owner[2];
+                    int preceding = edge_mask(ox, oy, oz) & ((1 << owner[3]) - 1);
+                    mesh.indices[out++] = slab_vertices[oz] + first_vertex[ox + points * (oy + (size_t)points * oz)] + std::popcount((unsigned int)preceding);
+                }
+            }
+        }
+    });
+
+    return mesh;
+}
+
+/**
+ * Sort keys along with the values they carry by a stable least significant digit radix sort. Every pass counts the
+ * digits of fixed blocks of keys in parallel, and scatters each block into its range of the output in parallel.
+ * 
+ * @param keys The keys to sort, of which only the low key_bits bits are used
+ * @param values The values to reorder along with the keys
+ * @param key_bits The number of bits in the keys
+ */
+static void radix_sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, int key_bits) {
+    constexpr int digit_bits = 11;
+    constexpr int buckets = 1 << digit_bits;
+    constexpr size_t block_size = 1 << 16;
+
+    size_t count = keys.size();
+    int blocks = (count + block_size - 1) / block_size;
+    std::vector<uint64_t> sorted_keys(count);
+    std::vector<uint32_t> sorted_values(count);
+    std::vector<size_t> offsets((size_t)blocks * buckets);
+
+    for (int shift = 0; shift < key_bits; shift += digit_bits) {
+        ThreadPool::get().parallel_for(0, blocks, [&](int block) {
+            size_t* histogram = &offsets[(size_t)block * buckets];
+            std::fill(histogram, histogram + buckets, 0);
+            size_t end = std::min(count, (block + 1) * block_size);
+            for (size_t i = block * block_size; i < end; i++)
+                histogram[(keys[i] >> shift) & (buckets - 1)]++;
+        });
+
+        // Each block's keys with a digit go after those of every smaller digit and of earlier blocks with the same digit
+        size_t total = 0;
+        bool single_digit = false;
+        for (int digit = 0; digit < buckets; digit++) {
+            size_t digit_start = total;
+            for (int block = 0; block < blocks; block++) {
+                size_t block_count = offsets[(size_t)block * buckets + digit];
+                offsets[(size_t)block * buckets + digit] = total;
+                total += block_count;
+            }
+            if (total - digit_start == count) single_digit = true;
+        }
+        if (single_digit) continue;
+
+        ThreadPool::get().parallel_for(0, blocks, [&](int block) {
+            size_t* offset = &offsets[(size_t)block * buckets];
+            size_t end = std::min(count, (block + 1) * block_size);
+            for (size_t i = block * block_size; i < end; i++) {
+                size_t out = offset[(keys[i] >> shift) & (buckets - 1)]++;
+                sorted_keys[out] = keys[i];
+                sorted_values[out] = values[i];
+            }
+        });
+        keys.swap(sorted_keys);
+        values.swap(sorted_values);
+    }
+}
+
+/**
+ * Merge the vertices of a mesh that lie within a tolerance of each other, such as the copies that neighbouring
+ * bricks each produce on their shared faces. Positions are quantized to the tolerance and radix sorted by their
+ * quantized key, so that vertices to merge end up next to each other. Each run of equal keys becomes one vertex,
+ * which keeps the position of the run's first vertex and the average of the run's normals. Triangles that the
+ * weld collapses are dropped.
+ * 
+ * @param mesh The mesh to weld in place, with positions in texture coordinates
+ * @param tolerance The size of the cells that positions are quantized to
+ * @return How many vertices were welded and how long it took
+ */
+WeldResult RD3D::weld_vertices(MarchingCubesMesh& mesh, float tolerance) {
+    auto start = std::chrono::steady_clock::now();
+    WeldResult result;
+    result.vertices_before = mesh.vertices.size();
+    if (mesh.vertices.empty()) return result;
+
+    constexpr int axis_bits = 21;
+    constexpr size_t block_size = 1 << 16;
+    size_t count = mesh.vertices.size();
+    int blocks = (count + block_size - 1) / block_size;
+
+    // Quantize each position into a key holding 21 bits per axis
+    std::vector<uint64_t> keys(count);
+    std::vector<uint32_t> order(count);
+    ThreadPool::get().parallel_for(0, blocks, [&](int block) {
+        size_t end = std::min(count, (block + 1) * block_size);
+        for (size_t i = block * block_size; i < end; i++) {
+            uint64_t key = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                float cell = std::round(mesh.vertices[i].pos[axis] / tolerance);
+                uint64_t quantized = (uint64_t)std::clamp(cell, 0.0f, (float)((1 << axis_bits) - 1));
+                key |= quantized << (axis * axis_bits);
+            }
+            keys[i] = key;
+            order[i] = i;
+        }
+    });
+
+    radix_sort(keys, order, 3 * axis_bits);
+
+    // Number the runs of equal keys, counting the runs that start in each block before offsetting them by the earlier blocks
+    std::vector<size_t> block_runs(blocks + 1, 0);
+    ThreadPool::get().parallel_for(0, blocks, [&](int block) {
+        size_t end = std::min(count, (block + 1) * block_size);
+        size_t runs = 0;
+        for (size_t i = block * block_size; i < end; i++)
+            if (i == 0 || keys[i] != keys[i - 1]) runs++;
+        block_runs[block + 1] = runs;
+    });
+    for (int block = 0; block < blocks; block++)
+        block_runs[block + 1] += block_runs[block];
+
+    size_t unique = block_runs[blocks];
+    std::vector<uint32_t> remap(count);
+    std::vector<size_t> run_starts(unique + 1, count);
+    ThreadPool::get().parallel_for(0, blocks, [&](int block) {
+        size_t end = std::min(count, (block + 1) * block_size);
+        size_t run = block_runs[block];
+        for (size_t i = block * block_size; i < end; i++) {
+            if (i == 0 || keys[i] != keys[i - 1]) run_starts[run++] = i;
+            remap[order[i]] = run - 1;
+        }
+    });
+
+    // The sort is stable, so the first vertex of a run is the one that came first in the mesh
+    std::vector<MarchingCubeVertex> vertices(unique);
+    int unique_blocks = (unique + block_size - 1) / block_size;
+    ThreadPool::get().parallel_for(0, unique_blocks, [&](int block) {
+        size_t end = std::min(unique, (block + 1) * block_size);
+        for (size_t run = block * block_size; run < end; run++) {
+            glm::vec3 normal(0.0f);
+            for (size_t i = run_starts[run]; i < run_starts[run + 1]; i++)
+                normal += mesh.vertices[order[i]].normal;
+
+            float length = glm::length(normal);
+            vertices[run].pos = mesh.vertices[order[run_starts[run]]].pos;
+            vertices[run].normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        }
+    });
+
+    size_t kept = 0;
+    for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+        unsigned int a = remap[mesh.indices[i]], b = remap[mesh.indices[i + 1]], c = remap[mesh.indices[i + 2]];
+        if (a == b || b == c || c == a) continue;
+        mesh.indices[kept++] = a;
+        mesh.indices[kept++] = b;
+        mesh.indices[kept++] = c;
+    }
+    mesh.indices.resize(kept);
+    mesh.vertices = std::move(vertices);
+
+    result.vertices_after = unique;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,217 @@
+#include "MeshCache.hpp"
+#include "MappedFile.hpp"
+#include "ObjLoader.hpp"
+
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+
+using namespace RD3D;
+
+static constexpr char cache_magic[8] = {'R', 'D', '3', 'D', 'M', 'S', 'H', '\0'};
+static constexpr uint32_t cache_version = 1;
+
+/**
+ * Header at the start of every mesh cache file. The arrays follow it back to back in the order
+ * vertices, indices, BVH nodes, BVH triangle order.
+ */
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertex_size;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t vertex_count;
+    uint64_t index_count;
+    uint64_t bvh_node_count;
+    uint64_t bvh_triangle_count;
+    float min[3];
+    float max[3];
+};
+
+/**
+ * Get the path of the cache file that belongs to an .obj file.
+ */
+static std::string cache_path(const std::string& obj_path) {
+    return obj_path + ".rd3dmesh";
+}
+
+/**
+ * Get the size and modification time of the .obj file, which a cache has to match to be used.
+ */
+static bool source_stamp(const std::string& obj_path, uint64_t& size, int64_t& mtime) {
+    std::error_code ec;
+    size = std::filesystem::file_size(obj_path, ec);
+    if (ec) return false;
+    mtime = std::filesystem::last_write_time(obj_path, ec).time_since_epoch().count();
+    return !ec;
+}
+
+/**
+ * Fill the mesh from a mapped cache file if it is valid and up to date with the .obj file.
+ */
+static bool read_cache(const std::string& obj_path, CachedMesh& mesh) {
+    uint64_t source_size;
+    int64_t source_mtime;
+    if (!source_stamp(obj_path, source_size, source_mtime)) return false;
+
+    MappedFile file(cache_path(obj_path));
+    if (!file.is_open() || file.size() < sizeof(CacheHeader)) return false;
+
+    CacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(CacheHeader));
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version || header.vertex_size != sizeof(Vertex)) return false;
+    if (header.source_size != source_size || header.source_mtime != source_mtime) return false;
+
+    // The counts are checked one at a time against what is left of the file, so that a corrupt count can't overflow the size
+    size_t remaining = file.size() - sizeof(CacheHeader);
+    auto take = [&remaining](uint64_t count, size_t element_size) {
+        if (count > remaining / element_size) return false;
+        remaining -= count * element_size;
+        return true;
+    };
+    if (!take(header.vertex_count, sizeof(Vertex)) || !take(header.index_count, sizeof(unsigned int))
+        || !take(header.bvh_node_count, sizeof(BVHNode)) || !take(header.bvh_triangle_count, sizeof(unsigned int)) || remaining != 0) return false;
+
+    const char* p = file.data() + sizeof(CacheHeader);
+    auto read_array = [&p](auto& array, uint64_t count) {
+        array.resize(count);
+        std::memcpy(array.data(), p, count * sizeof(array[0]));
+        p += count * sizeof(array[0]);
+    };
+
+    read_array(mesh.vertices, header.vertex_count);
+    read_array(mesh.indices, header.index_count);
+    read_array(mesh.bvh_nodes, header.bvh_node_count);
+    read_array(mesh.bvh_triangle_order, header.bvh_triangle_count);
+    mesh.min = glm::vec3(header.min[0], header.min[1], header.min[2]);
+    mesh.max = glm::vec3(header.max[0], header.max[1], header.max[2]);
+
+    // A damaged cache could still index out of the arrays, in which case the .obj file is parsed again
+    if (mesh.indices.size() % 3 != 0) return false;
+    for (unsigned int index : mesh.indices)
+        if (index >= mesh.vertices.size()) return false;
+    if (!mesh.bvh_nodes.empty() && !BVH::is_valid(mesh.bvh_nodes, mesh.bvh_triangle_order, mesh.indices.size() / 3)) return false;
+    if (mesh.bvh_nodes.empty() && !mesh.bvh_triangle_order.empty()) return false;
+    return true;
+}
+
+/**
+ * Turn the corners of a loaded .obj file into an indexed mesh where each distinct combination
+ * of position, texture coordinate, and normal becomes one vertex.
+ */
+static void index_obj(const ObjData& data, CachedMesh& mesh) {
+    struct CornerHash {
+        size_t operator()(const ObjIndex& i) const {
+            return ((size_t)i.position * 73856093) ^ ((size_t)(i.texcoord + 1) * 19349663) ^ ((size_t)(i.normal + 1) * 83492791);
+        }
+    };
+    struct CornerEqual {
+        bool operator()(const ObjIndex& a, const ObjIndex& b) const {
+            return a.position == b.position && a.texcoord == b.texcoord && a.normal == b.normal;
+        }
+    };
+
+    std::unordered_map<ObjIndex, unsigned int, CornerHash, CornerEqual> vertex_map;
+    vertex_map.reserve(data.positions.size());
+    mesh.vertices.clear();
+    mesh.indices.resize(data.indices.size());
+
+    for (size_t i = 0; i < data.indices.size(); i++) {
+        ObjIndex corner = data.indices[i];
+        auto [it, inserted] = vertex_map.try_emplace(corner, (unsigned int)mesh.vertices.size());
+        if (inserted) {
+            mesh.vertices.emplace_back(
+                data.positions[corner.position],
+                corner.texcoord >= 0 ? data.texcoords[corner.texcoord] : glm::vec2(0.0f, 0.0f),
+                corner.normal >= 0 ? data.normals[corner.normal] : glm::vec3(0.0f, 0.0f, 0.0f)
+            );
+        }
+        mesh.indices[i] = it->second;
+    }
+
+    mesh.min = glm::vec3(FLT_MAX);
+    mesh.max = glm::vec3(-FLT_MAX);
+    for (auto& vertex : mesh.vertices) {
+        mesh.min = glm::min(mesh.min, vertex.position);
+        mesh.max = glm::max(mesh.max, vertex.position);
+    }
+    if (mesh.vertices.empty()) mesh.min = mesh.max = glm::vec3(0.0f);
+}
+
+/**
+ * Get the position of every vertex.
+ */
+std::vector<glm::vec3> CachedMesh::get_positions() const {
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+        positions[i] = vertices[i].position;
+    return positions;
+}
+
+/**
+ * Load a mesh from the binary cache next to an .obj file. If there is no cache or it is out of date,
+ * the .obj file is parsed instead and a new cache is written for the next time.
+ * 
+ * @param obj_path File path to the .obj file
+ * @param mesh The loaded mesh
+ * @param error Description of what went wrong if loading failed
+ * @return Whether the mesh was loaded successfully
+ */
+bool RD3D::load_cached_mesh(const std::string& obj_path, CachedMesh& mesh, std::string& error) {
+    mesh = CachedMesh();
+    if (read_cache(obj_path, mesh)) return true;
+
+    mesh = CachedMesh();
+    ObjData data;
+    if (!load_obj(obj_path, data, error)) return false;
+    index_obj(data, mesh);
+    write_mesh_cache(obj_path, mesh);
+    return true;
+}
+
+/**
+ * Write the binary cache for an .obj file, stamped with the .obj file's size and modification time.
+ * Failing to write the cache (e.g. in a read only directory) is not an error, the .obj file is simply parsed again next time.
+ * 
+ * @param obj_path File path to the .obj file the mesh was loaded from
+ * @param mesh The mesh to store
+ * @return Whether the cache was written
+ */
+bool RD3D::write_mesh_cache(const std::string& obj_path, const CachedMesh& mesh) {
+    CacheHeader header = {};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.vertex_size = sizeof(Vertex);
+    if (!source_stamp(obj_path, header.source_size, header.source_mtime)) return false;
+    header.vertex_count = mesh.vertices.size();
+    header.index_count = mesh.indices.size();
+    header.bvh_node_count = mesh.bvh_nodes.size();
+    header.bvh_triangle_count = mesh.bvh_triangle_order.size();
+    for (int i = 0; i < 3; i++) {
+        header.min[i] = mesh.min[i];
+        header.max[i] = mesh.max[i];
+    }
+
+    // Write to a temporary file first so that a half written cache is never picked up
+    std::string path = cache_path(obj_path);
+    std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return false;
+
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+        file.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+        file.write((const char*)mesh.bvh_nodes.data(), mesh.bvh_nodes.size() * sizeof(BVHNode));
+        file.write((const char*)mesh.bvh_triangle_order.data(), mesh.bvh_triangle_order.size() * sizeof(unsigned int));
+        if (!file) return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temporary_path, path, ec);
+    return !ec;
+}
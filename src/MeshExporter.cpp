@@ -0,0 +1,381 @@
+#include "MeshExporter.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace RD3D;
+
+// The binary formats are all little-endian, and are written by copying floats and integers straight from memory
+static_assert(std::endian::native == std::endian::little, "Binary mesh export assumes a little-endian host");
+
+// Meshes are extracted in texture coordinates, and are exported centered on the origin like they are drawn
+static constexpr float export_offset = 0.5f;
+
+// Records per chunk of text formatted by one task
+static constexpr size_t text_chunk_records = 16384;
+
+/**
+ * Writes a file through one large buffer, so that records can be converted in place into the buffer
+ * and reach the file in big blocks.
+ */
+class BlockWriter {
+public:
+    static constexpr size_t block_size = 4 << 20;
+
+    BlockWriter(const std::string& path) : file(path, std::ios::binary | std::ios::trunc), buffer(block_size) {}
+
+    bool is_open() const {
+        return file.is_open();
+    }
+
+    /**
+     * Get space in the buffer for the next records, which are written once committed.
+     *
+     * @param bytes The number of bytes to reserve, at most block_size
+     */
+    char* reserve(size_t bytes) {
+        if (used + bytes > buffer.size()) flush();
+        return buffer.data() + used;
+    }
+
+    void commit(size_t bytes) {
+        used += bytes;
+    }
+
+    /**
+     * Write data that is already in its final layout, going straight to the file when it fills a block.
+     */
+    void write(const void* data, size_t bytes) {
+        if (bytes >= block_size) {
+            flush();
+            file.write((const char*)data, bytes);
+            return;
+        }
+        std::memcpy(reserve(bytes), data, bytes);
+        commit(bytes);
+    }
+
+    bool finish() {
+        flush();
+        file.close();
+        return !file.fail();
+    }
+private:
+    std::ofstream file;
+    std::vector<char> buffer;
+    size_t used = 0;
+
+    void flush() {
+        file.write(buffer.data(), used);
+        used = 0;
+    }
+};
+
+/**
+ * Convert records in batches that fill the writer's buffer.
+ *
+ * @param count The number of records
+ * @param record_size The size in bytes of each converted record
+ * @param convert Called with the first record of a batch, the number of records and where to write them
+ */
+template <typename Convert>
+static void write_records(BlockWriter& writer, size_t count, size_t record_size, Convert convert) {
+    size_t batch = BlockWriter::block_size / record_size;
+    for (size_t first = 0; first < count; first += batch) {
+        size_t records = std::min(batch, count - first);
+        convert(first, records, writer.reserve(records * record_size));
+        writer.commit(records * record_size);
+    }
+}
+
+/**
+ * Format records as text into fixed chunks in parallel, then write the chunks to the file in order. Chunks
+ * always hold the same records whatever the number of threads, so the output is the same on every machine.
+ *
+ * @param count The number of records
+ * @param max_record_size The most characters a single record can take
+ * @param format Called with a record and where to write it, and returns the end of what it wrote
+ */
+template <typename Format>
+static void write_text_records(std::ofstream& file, size_t count, size_t max_record_size, Format format) {
+    size_t chunks = (count + text_chunk_records - 1) / text_chunk_records;
+    size_t batch_size = std::min(chunks, (size_t)4 * ThreadPool::get().size());
+    std::vector<std::vector<char>> buffers(batch_size, std::vector<char>(text_chunk_records * max_record_size));
+    std::vector<size_t> lengths(batch_size);
+
+    // Chunks are formatted a batch at a time, which bounds the memory held by formatted text
+    for (size_t first_chunk = 0; first_chunk < chunks; first_chunk += batch_size) {
+        size_t batch_chunks = std::min(batch_size, chunks - first_chunk);
+        ThreadPool::get().parallel_for(0, batch_chunks, [&](int i) {
+            size_t first = (first_chunk + i) * text_chunk_records;
+            size_t last = std::min(first + text_chunk_records, count);
+            char* out = buffers[i].data();
+            for (size_t record = first; record < last; record++)
+                out = format(record, out);
+            lengths[i] = out - buffers[i].data();
+        });
+
+        for (size_t i = 0; i < batch_chunks; i++)
+            file.write(buffers[i].data(), lengths[i]);
+    }
+}
+
+/**
+ * Write a float with six significant digits, the same as iostream's default formatting.
+ */
+static char* format_float(char* out, float value) {
+    return std::to_chars(out, out + 16, value, std::chars_format::general, 6).ptr;
+}
+
+static char* format_index(char* out, unsigned int index) {
+    return std::to_chars(out, out + 10, index).ptr;
+}
+
+/**
+ * Write a Wavefront .obj file with a position and normal per vertex.
+ */
+static bool write_obj(const MarchingCubesMesh& mesh, const std::string& path) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    // Vertices are already shared between triangles, so each one is written once with its own normal
+    write_text_records(file, mesh.vertices.size(), 64, [&](size_t i, char* out) {
+        glm::vec3 pos = mesh.vertices[i].pos - export_offset;
+        *out++ = 'v';
+        for (int axis = 0; axis < 3; axis++) {
+            *out++ = ' ';
+            out = format_float(out, pos[axis]);
+        }
+        *out++ = '\n';
+        return out;
+    });
+
+    write_text_records(file, mesh.vertices.size(), 64, [&](size_t i, char* out) {
+        const glm::vec3& normal = mesh.vertices[i].normal;
+        *out++ = 'v';
+        *out++ = 'n';
+        for (int axis = 0; axis < 3; axis++) {
+            *out++ = ' ';
+            out = format_float(out, normal[axis]);
+        }
+        *out++ = '\n';
+        return out;
+    });
+
+    write_text_records(file, mesh.indices.size() / 3, 80, [&](size_t i, char* out) {
+        const unsigned int* triangle = &mesh.indices[3 * i];
+        *out++ = 'f';
+        for (int corner = 0; corner < 3; corner++) {
+            *out++ = ' ';
+            out = format_index(out, triangle[corner] + 1);
+            *out++ = '/';
+            *out++ = '/';
+            out = format_index(out, triangle[corner] + 1);
+        }
+        *out++ = '\n';
+        return out;
+    });
+
+    file.close();
+    return !file.fail();
+}
+
+/**
+ * Write a binary little-endian PLY file, with a position and normal per vertex and a list of three indices per face.
+ */
+static bool write_ply(const MarchingCubesMesh& mesh, const std::string& path) {
+    BlockWriter writer(path);
+    if (!writer.is_open()) return false;
+
+    size_t triangles = mesh.indices.size() / 3;
+    std::string header =
+        "ply\n"
+        "format binary_little_endian 1.0\n"
+        "element vertex " + std::to_string(mesh.vertices.size()) + "\n"
+        "property float x\nproperty float y\nproperty float z\n"
+        "property float nx\nproperty float ny\nproperty float nz\n"
+        "element face " + std::to_string(triangles) + "\n"
+        "property list uchar uint vertex_indices\n"
+        "end_header\n";
+    writer.write(header.data(), header.size());
+
+    write_records(writer, mesh.vertices.size(), 6 * sizeof(float), [&](size_t first, size_t count, char* out) {
+        for (size_t i = 0; i < count; i++) {
+            const MarchingCubeVertex& vertex = mesh.vertices[first + i];
+            glm::vec3 pos = vertex.pos - export_offset;
+            float record[6] = {pos.x, pos.y, pos.z, vertex.normal.x, vertex.normal.y, vertex.normal.z};
+            std::memcpy(out + i * sizeof(record), record, sizeof(record));
+        }
+    });
+
+    // Each face is a one byte count followed by three indices, so records are packed rather than aligned
+    constexpr size_t face_size = 1 + 3 * sizeof(uint32_t);
+    write_records(writer, triangles, face_size, [&](size_t first, size_t count, char* out) {
+        for (size_t i = 0; i < count; i++) {
+            out[i * face_size] = 3;
+            std::memcpy(out + i * face_size + 1, &mesh.indices[3 * (first + i)], 3 * sizeof(uint32_t));
+        }
+    });
+
+    return writer.finish();
+}
+
+/**
+ * Write a binary STL file, which stores every triangle on its own with its face normal.
+ */
+static bool write_stl(const MarchingCubesMesh& mesh, const std::string& path) {
+    BlockWriter writer(path);
+    if (!writer.is_open()) return false;
+
+    char header[80] = {};
+    std::strncpy(header, "reaction-diffusion-3D", sizeof(header));
+    uint32_t triangles = mesh.indices.size() / 3;
+    writer.write(header, sizeof(header));
+    writer.write(&triangles, sizeof(triangles));
+
+    // A normal, three corners and a two byte attribute count per triangle
+    constexpr size_t triangle_size = 12 * sizeof(float) + sizeof(uint16_t);
+    write_records(writer, triangles, triangle_size, [&](size_t first, size_t count, char* out) {
+        for (size_t i = 0; i < count; i++) {
+            const unsigned int* triangle = &mesh.indices[3 * (first + i)];
+            glm::vec3 a = mesh.vertices[triangle[0]].pos - export_offset;
+            glm::vec3 b = mesh.vertices[triangle[1]].pos - export_offset;
+            glm::vec3 c = mesh.vertices[triangle[2]].pos - export_offset;
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float length = glm::length(n);
+            if (length > 0.0f) n /= length;
+
+            float record[12] = {n.x, n.y, n.z, a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z};
+            uint16_t attributes = 0;
+            std::memcpy(out + i * triangle_size, record, sizeof(record));
+            std::memcpy(out + i * triangle_size + sizeof(record), &attributes, sizeof(attributes));
+        }
+    });
+
+    return writer.finish();
+}
+
+/**
+ * Append the shortest text that reads back as exactly the same float.
+ */
+static void append_float(std::string& text, float value) {
+    char digits[32];
+    auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+    text.append(digits, end);
+}
+
+/**
+ * Write a binary glTF file holding one indexed triangle mesh, with positions, normals and indices in
+ * consecutive views of the single binary buffer.
+ */
+static bool write_glb(const MarchingCubesMesh& mesh, const std::string& path) {
+    BlockWriter writer(path);
+    if (!writer.is_open()) return false;
+
+    // glTF requires the bounds of the positions
+    glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+    for (const MarchingCubeVertex& vertex : mesh.vertices) {
+        min = glm::min(min, vertex.pos - export_offset);
+        max = glm::max(max, vertex.pos - export_offset);
+    }
+    if (mesh.vertices.empty()) min = max = glm::vec3(0.0f);
+
+    size_t vertex_bytes = mesh.vertices.size() * 3 * sizeof(float);
+    size_t index_bytes = mesh.indices.size() * sizeof(uint32_t);
+    size_t buffer_bytes = 2 * vertex_bytes + index_bytes;
+
+    std::string json = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"reaction-diffusion-3D\"},"
+        "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+        "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2,\"mode\":4}]}],"
+        "\"buffers\":[{\"byteLength\":" + std::to_string(buffer_bytes) + "}],"
+        "\"bufferViews\":["
+        "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" + std::to_string(vertex_bytes) + ",\"target\":34962},"
+        "{\"buffer\":0,\"byteOffset\":" + std::to_string(vertex_bytes) + ",\"byteLength\":" + std::to_string(vertex_bytes) + ",\"target\":34962},"
+        "{\"buffer\":0,\"byteOffset\":" + std::to_string(2 * vertex_bytes) + ",\"byteLength\":" + std::to_string(index_bytes) + ",\"target\":34963}],"
+        "\"accessors\":["
+        "{\"bufferView\":0,\"componentType\":5126,\"count\":" + std::to_string(mesh.vertices.size()) + ",\"type\":\"VEC3\",\"min\":[";
+    for (int i = 0; i < 3; i++) {
+        if (i > 0) json += ",";
+        append_float(json, min[i]);
+    }
+    json += "],\"max\":[";
+    for (int i = 0; i < 3; i++) {
+        if (i > 0) json += ",";
+        append_float(json, max[i]);
+    }
+    json += "]},"
+        "{\"bufferView\":1,\"componentType\":5126,\"count\":" + std::to_string(mesh.vertices.size()) + ",\"type\":\"VEC3\"},"
+        "{\"bufferView\":2,\"componentType\":5125,\"count\":" + std::to_string(mesh.indices.size()) + ",\"type\":\"SCALAR\"}]}";
+
+    // Chunks must be 4 byte aligned, with the JSON padded by spaces
+    json.append((4 - json.size() % 4) % 4, ' ');
+
+    uint32_t header[3] = {0x46546C67, 2, (uint32_t)(12 + 8 + json.size() + 8 + buffer_bytes)};
+    uint32_t json_chunk[2] = {(uint32_t)json.size(), 0x4E4F534A};
+    uint32_t binary_chunk[2] = {(uint32_t)buffer_bytes, 0x004E4942};
+    writer.write(header, sizeof(header));
+    writer.write(json_chunk, sizeof(json_chunk));
+    writer.write(json.data(), json.size());
+    writer.write(binary_chunk, sizeof(binary_chunk));
+
+    write_records(writer, mesh.vertices.size(), 3 * sizeof(float), [&](size_t first, size_t count, char* out) {
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 pos = mesh.vertices[first + i].pos - export_offset;
+            float record[3] = {pos.x, pos.y, pos.z};
+            std::memcpy(out + i * sizeof(record), record, sizeof(record));
+        }
+    });
+    write_records(writer, mesh.vertices.size(), 3 * sizeof(float), [&](size_t first, size_t count, char* out) {
+        for (size_t i = 0; i < count; i++) {
+            const glm::vec3& normal = mesh.vertices[first + i].normal;
+            float record[3] = {normal.x, normal.y, normal.z};
+            std::memcpy(out + i * sizeof(record), record, sizeof(record));
+        }
+    });
+
+    // The indices are already 32 bit little-endian, so they go to the file as they are
+    writer.write(mesh.indices.data(), index_bytes);
+
+    return writer.finish();
+}
+
+/**
+ * Get the file extension of a mesh format, without the dot.
+ */
+const char* RD3D::mesh_format_extension(MeshFormat format) {
+    switch (format) {
+        case MeshFormat::PLY: return "ply";
+        case MeshFormat::STL: return "stl";
+        case MeshFormat::GLB: return "glb";
+        default: return "obj";
+    }
+}
+
+/**
+ * Write a mesh extracted from the grid to a file, centered on the origin.
+ *
+ * @param mesh The mesh in texture coordinates
+ * @param path Where to write the file
+ * @param format The format to write the mesh in
+ * @return Whether the whole file was written
+ */
+bool RD3D::write_mesh(const MarchingCubesMesh& mesh, const std::string& path, MeshFormat format) {
+    bool written = false;
+    switch (format) {
+        case MeshFormat::OBJ: written = write_obj(mesh, path); break;
+        case MeshFormat::PLY: written = write_ply(mesh, path); break;
+        case MeshFormat::STL: written = write_stl(mesh, path); break;
+        case MeshFormat::GLB: written = write_glb(mesh, path); break;
+    }
+
+    if (!written) std::cerr << "[ERROR] Failed to write export file '" << path << "'" << std::endl;
+    return written;
+}
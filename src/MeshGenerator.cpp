@@ -1,180 +1,939 @@
 #include <imgui/imgui.h>
 
 #include <glm/gtc/matrix_transform.hpp>
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
 #include <nfd.h>
 
 #include "MeshGenerator.hpp"
 #include "MarchingCubesTables.hpp"
+#include "SurfaceNets.hpp"
+#include "MeshExporter.hpp"
 
-#include <fstream>
-#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 
 using namespace RD3D;
 
 MeshGenerator::MeshGenerator(int grid_resolution) :
+    changes_shader("shaders/marching_cubes_changes.glsl"),
     marching_cubes_shader("shaders/marching_cubes.glsl"),
     mesh_shader("shaders/rd3d_mesh.vert", "shaders/rd3d_mesh.frag")
 {
+    for (size_t i = 0; i < levels.size(); i++)
+        levels[i].step = 1 << i;
+
     init_marching_cubes_tables();
-    init_buffers(grid_resolution);
+    allocate_level(levels[viewport_level], grid_resolution);
+}
+
+MeshGenerator::~MeshGenerator() {
+    if (export_job && export_job->worker.joinable()) export_job->worker.join();
+    if (smoothed_viewport.worker.joinable()) smoothed_viewport.worker.join();
+}
+
+/**
+ * Triangulate every isosurface of the scalar field generated by the Gray-Scott model at the level of detail shown
+ * in the viewport, remeshing only the bricks where the field has changed by more than the tolerance. Nothing is
+ * dispatched if neither the grid nor the mesh settings have changed since the level was last generated.
+ * 
+ * @param grid_resolution The simulation grid's resolution
+ * @param grid_texture OpenGL texture object refering to the 3D grid
+ * @param grid_version The simulator's count of changes to the grid texture
+ */
+void MeshGenerator::generate(int grid_resolution, GLuint grid_texture, unsigned long long grid_version) {
+    MeshLevel& level = levels[viewport_level];
+    upload_seconds = 0.0;
+    bool generated = false;
+    auto start = std::chrono::steady_clock::now();
+
+    if (level.vao != 0) poll_level_status(level, grid_resolution, grid_texture);
+
+    if (level.extracted_version != grid_version || level.force_remesh) {
+        // A query can only be started again once its result has been read
+        bool timed = collect_statistics && !extraction_query_pending;
+        if (timed) {
+            if (extraction_query == 0) glGenQueries(1, &extraction_query);
+            glBeginQuery(GL_TIME_ELAPSED, extraction_query);
+        }
+
+        generate_level(level, grid_resolution, grid_texture, false);
+        level.extracted_version = grid_version;
+        generated = true;
+
+        if (timed) {
+            glEndQuery(GL_TIME_ELAPSED);
+            extraction_query_pending = true;
+        }
+    }
+    double generate_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (smooth_viewport) update_smoothed_viewport(grid_resolution);
+    if (!collect_statistics) return;
+    gather_timings(generated ? generate_seconds : -1.0);
+
+    // Without a new generation the counts only need copying when the statistics describe some other layout
+    bool current = statistics.step == level.step && statistics.surface_count == level.surface_count && statistics.bricks == (size_t)level.brick_count();
+    if (!current && level.vao != 0 && level.status_fence == 0) copy_level_status(level);
+}
+
+/**
+ * Update the timings of the viewport level's statistics. The GPU time of the extraction is picked up once its
+ * query has finished, which is usually a frame or two later.
+ * 
+ * @param generate_seconds CPU time of the level's generation this frame, or a negative number if it was not generated
+ */
+void MeshGenerator::gather_timings(double generate_seconds) {
+    if (extraction_query_pending) {
+        GLint available = 0;
+        glGetQueryObjectiv(extraction_query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(extraction_query, GL_QUERY_RESULT, &nanoseconds);
+            statistics.extraction_ms = nanoseconds / 1e6;
+            extraction_query_pending = false;
+        }
+    }
+    if (upload_seconds > 0.0) statistics.upload_ms = upload_seconds * 1000.0;
+    if (generate_seconds >= 0.0) statistics.generate_ms = generate_seconds * 1000.0;
 }
 
 /**
- * Dispatch the compute shader which runs to Marching Cubes algorhthim to
+ * Update the counts of the viewport level's statistics, summed from the copy of its chunks in its status buffer.
+ * 
+ * @param level The viewport level, whose status buffer holds its chunks and has been signalled
+ */
+void MeshGenerator::gather_statistics(const MeshLevel& level) {
+    const MeshChunk* chunks = level.status_chunks;
+    size_t chunk_count = level.chunk_count();
+
+    statistics.step = level.step;
+    statistics.surface_count = level.surface_count;
+    statistics.bricks = level.brick_count();
+    statistics.remeshed_bricks = level.remeshed_bricks;
+    statistics.active_cells = 0;
+    statistics.vertices = 0;
+    statistics.triangles = 0;
+    statistics.surface_triangles.assign(level.surface_count, 0);
+
+    size_t indices = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+        statistics.active_cells += chunks[i].active_cells;
+        statistics.vertices += chunks[i].vertex_count;
+        statistics.surface_triangles[i / level.brick_count()] += chunks[i].index_count / 3;
+        indices += chunks[i].index_count;
+    }
+    statistics.triangles = indices / 3;
+
+    statistics.vertex_bytes_used = statistics.vertices * sizeof(MarchingCubeVertex);
+    statistics.vertex_bytes_allocated = level.vertex_capacity * sizeof(MarchingCubeVertex);
+    statistics.index_bytes_used = indices * sizeof(unsigned int);
+    statistics.index_bytes_allocated = level.index_capacity * sizeof(unsigned int);
+    statistics.brick_bytes_allocated = chunk_count * (2 * sizeof(MeshChunk) + sizeof(DrawElementsCommand))
+        + level.brick_count() * (sizeof(GLuint) + 512 * 2 * sizeof(float));
+}
+
+/**
+ * Get the statistics of the viewport level, which are only kept up to date while they are enabled in the GUI.
+ */
+const MeshStatistics& MeshGenerator::get_statistics() const {
+    return statistics;
+}
+
+/**
+ * Gather the chunks of a mesh extracted on the GPU into one mesh. Vertices on the faces between bricks are
+ * produced by both bricks, so the mesh still has to be welded.
+ * 
+ * @param chunks The chunk of every brick
+ * @param brick_count The number of bricks
+ * @param vertices The level's vertex buffer
+ * @param indices The level's index buffer, with indices relative to each chunk's first vertex
+ */
+static MarchingCubesMesh gather_chunks(const MeshChunk* chunks, size_t brick_count, const MarchingCubeVertex* vertices, const unsigned int* indices) {
+    MarchingCubesMesh mesh;
+    for (size_t i = 0; i < brick_count; i++) {
+        const MeshChunk& chunk = chunks[i];
+        unsigned int base_vertex = mesh.vertices.size();
+        mesh.vertices.insert(mesh.vertices.end(), vertices + chunk.first_vertex, vertices + chunk.first_vertex + chunk.vertex_count);
+        for (size_t j = 0; j < chunk.index_count; j++)
+            mesh.indices.push_back(base_vertex + indices[chunk.first_index + j]);
+    }
+    return mesh;
+}
+
+/**
+ * Keep the smoothed copy of the viewport's surfaces up to date, called once per frame. If the viewport mesh has
+ * changed since it was last smoothed and enough frames have passed, its chunks, vertices and indices are copied
+ * into a staging buffer behind a fence. Once the fence has signalled the mapped buffer is handed to a worker which
+ * gathers, welds and smooths each surface, and once the worker is done its meshes are uploaded.
+ * 
+ * @param grid_resolution The simulation grid's resolution
+ */
+void MeshGenerator::update_smoothed_viewport(int grid_resolution) {
+    SmoothedViewport& smoothed = smoothed_viewport;
+    if (smoothed.fence != 0) {
+        GLenum status = glClientWaitSync(smoothed.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED) return;
+        glDeleteSync(smoothed.fence);
+        smoothed.fence = 0;
+
+        const char* data = NULL;
+        if (status != GL_WAIT_FAILED) {
+            glBindBuffer(GL_COPY_READ_BUFFER, smoothed.staging_buffer);
+            data = (const char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, smoothed.staging_size, GL_MAP_READ_BIT);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        if (data == NULL) {
+            std::cerr << "[ERROR] Failed to read back the viewport mesh for smoothing" << std::endl;
+            smoothed.version = SmoothedViewport::outdated;
+            return;
+        }
+
+        float weld_tolerance = 0.001f / grid_resolution;
+        smoothed.done = false;
+        smoothed.worker = std::thread([&smoothed, data, settings = smoothing, weld_tolerance]() {
+            const MeshChunk* chunks = (const MeshChunk*)data;
+            const MarchingCubeVertex* vertices = (const MarchingCubeVertex*)(data + smoothed.surface_count * smoothed.brick_count * sizeof(MeshChunk));
+            const unsigned int* indices = (const unsigned int*)((const char*)vertices + smoothed.vertex_capacity * sizeof(MarchingCubeVertex));
+
+            for (int i = 0; i < smoothed.surface_count; i++) {
+                MarchingCubesMesh& mesh = smoothed.surfaces[i].mesh;
+                mesh = gather_chunks(chunks + i * smoothed.brick_count, smoothed.brick_count, vertices, indices);
+                weld_vertices(mesh, weld_tolerance);
+                smooth_mesh(mesh, settings);
+            }
+            smoothed.done = true;
+        });
+        return;
+    }
+
+    if (smoothed.worker.joinable()) {
+        if (!smoothed.done) return;
+        smoothed.worker.join();
+
+        glBindBuffer(GL_COPY_READ_BUFFER, smoothed.staging_buffer);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        auto upload_start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < smoothed.surface_count; i++) {
+            SmoothedSurface& surface = smoothed.surfaces[i];
+            if (surface.vao == 0) {
+                glGenVertexArrays(1, &surface.vao);
+                glGenBuffers(1, &surface.vbo);
+                glGenBuffers(1, &surface.ebo);
+
+                glBindVertexArray(surface.vao);
+                glBindBuffer(GL_ARRAY_BUFFER, surface.vbo);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surface.ebo);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MarchingCubeVertex), (void*)0);
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MarchingCubeVertex), (void*)offsetof(MarchingCubeVertex, normal));
+                glEnableVertexAttribArray(1);
+                glBindVertexArray(0);
+            }
+
+            glBindBuffer(GL_ARRAY_BUFFER, surface.vbo);
+            glBufferData(GL_ARRAY_BUFFER, surface.mesh.vertices.size() * sizeof(MarchingCubeVertex), surface.mesh.vertices.data(), GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, surface.ebo);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, surface.mesh.indices.size() * sizeof(unsigned int), surface.mesh.indices.data(), GL_DYNAMIC_DRAW);
+            surface.index_count = surface.mesh.indices.size();
+        }
+        smoothed.uploaded_surfaces = smoothed.surface_count;
+        smoothed.uploaded_level = smoothed.level;
+        smoothed.uploaded_version = smoothed.version;
+        upload_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - upload_start).count();
+    }
+
+    MeshLevel& level = levels[viewport_level];
+    smoothed.frames_since_smoothing++;
+    if (smoothed.level == viewport_level && smoothed.version == level.extracted_version) return;
+    if (smoothed.level == viewport_level && smoothed.frames_since_smoothing < smooth_interval) return;
+
+    smoothed.level = viewport_level;
+    smoothed.version = level.extracted_version;
+    smoothed.surface_count = level.surface_count;
+    smoothed.brick_count = level.brick_count();
+    smoothed.vertex_capacity = level.vertex_capacity;
+    smoothed.frames_since_smoothing = 0;
+
+    GLsizeiptr chunk_bytes = level.chunk_count() * sizeof(MeshChunk);
+    GLsizeiptr vertex_bytes = level.vertex_capacity * sizeof(MarchingCubeVertex);
+    GLsizeiptr index_bytes = level.index_capacity * sizeof(unsigned int);
+    smoothed.staging_size = chunk_bytes + vertex_bytes + index_bytes;
+
+    if (smoothed.staging_buffer == 0) glGenBuffers(1, &smoothed.staging_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, smoothed.staging_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, smoothed.staging_size, NULL, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_READ_BUFFER, level.chunks_ssbo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, chunk_bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, level.vbo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, chunk_bytes, vertex_bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, level.ebo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, chunk_bytes + vertex_bytes, index_bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    smoothed.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/**
+ * Dispatch the compute shaders which run the Marching Cubes algorhthim to
  * triangulate the scalar field generated by the Gray-Scott model.
  * 
+ * The mesh is split into bricks of 7^3 cells, each with its own chunk of the vertex and index buffers
+ * and its own draw command for every isosurface. The first pass compares the field at each brick's grid points
+ * against the values it was last extracted from and lists the bricks whose largest change exceeds the tolerance.
+ * The second pass is dispatched indirectly with one work group per listed brick, reads the brick's field once,
+ * and rewrites only those bricks' chunks of every surface.
+ * 
+ * If a brick's mesh outgrows its chunk, the brick is left empty and an overflow flag is set. The flag is copied
+ * into the level's mapped status buffer behind a fence by copy_level_status and checked by poll_level_status,
+ * usually a frame later, so that the CPU never waits on the extraction.
+ * 
+ * @param level The level of detail to generate
  * @param grid_resolution The simulation grid's resolution
  * @param grid_texture OpenGL texture object refering to the 3D grid
+ * @param force_remesh Whether to remesh every brick regardless of the tolerance
  */
-void MeshGenerator::generate(int grid_resolution, GLuint grid_texture) {
+void MeshGenerator::generate_level(MeshLevel& level, int grid_resolution, GLuint grid_texture, bool force_remesh) {
+    if (level.vao == 0 || level.surface_count != (int)isosurfaces.size()) allocate_level(level, grid_resolution);
+
+    int used_channels = 0;
+    for (const Isosurface& surface : isosurfaces)
+        used_channels |= 1 << (int)surface.channel;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, level.vbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, level.dirty_bricks_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, level.dispatch_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, level.ebo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, level.extracted_values_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, level.chunks_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, level.draw_commands_buffer);
+
+    // The overflow flag is left alone, so that it stays set until the chunks have been laid out again
+    GLuint groups[3] = {0, 1, 1};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.dispatch_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(groups), groups);
+
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_3D, grid_texture);
 
+    changes_shader.bind();
+    changes_shader.set_float("grid_resolution", (float)grid_resolution);
+    changes_shader.set_int("step", level.step);
+    changes_shader.set_int("cells_per_axis", level.cells_per_axis);
+    changes_shader.set_int("bricks_per_axis", level.bricks_per_axis);
+    changes_shader.set_float("tolerance", remesh_tolerance);
+    changes_shader.set_bool("force_remesh", force_remesh || level.force_remesh);
+    changes_shader.set_int("used_channels", used_channels);
+    changes_shader.set_int("grid_tex", 0);
+
+    glDispatchCompute(level.bricks_per_axis, level.bricks_per_axis, level.bricks_per_axis);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
     marching_cubes_shader.bind();
-	marching_cubes_shader.set_float("grid_resolution", (float)grid_resolution);
-    marching_cubes_shader.set_float("threshold", threshold);
-	marching_cubes_shader.set_int("grid_tex", 0);
+    marching_cubes_shader.set_float("grid_resolution", (float)grid_resolution);
+    marching_cubes_shader.set_int("step", level.step);
+    marching_cubes_shader.set_int("cells_per_axis", level.cells_per_axis);
+    marching_cubes_shader.set_int("bricks_per_axis", level.bricks_per_axis);
+    marching_cubes_shader.set_int("surface_count", level.surface_count);
+    for (int i = 0; i < level.surface_count; i++) {
+        marching_cubes_shader.set_float("thresholds[" + std::to_string(i) + "]", isosurfaces[i].threshold);
+        marching_cubes_shader.set_int("channels[" + std::to_string(i) + "]", (int)isosurfaces[i].channel);
+    }
+    marching_cubes_shader.set_int("grid_tex", 0);
 
-    glDispatchCompute(grid_resolution / 2, grid_resolution / 2, grid_resolution / 2);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, level.dispatch_buffer);
+    glDispatchComputeIndirect(0);
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    level.force_remesh = false;
+
+    copy_level_status(level);
 }
 
 /**
- * Resize the vertex buffer to match the grid resolution.
+ * Copy a level's dispatch buffer, and its chunks while statistics are collected, into its mapped status buffer
+ * behind a fence. Only the latest copy matters, and the overflow flag carries over from earlier generations.
+ * 
+ * @param level The level of detail whose status to copy
+ */
+void MeshGenerator::copy_level_status(MeshLevel& level) {
+    level.status_has_chunks = collect_statistics;
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, level.status_buffer);
+    glBindBuffer(GL_COPY_READ_BUFFER, level.dispatch_buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(BrickDispatch));
+    if (level.status_has_chunks) {
+        glBindBuffer(GL_COPY_READ_BUFFER, level.chunks_ssbo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, sizeof(BrickDispatch), level.chunk_count() * sizeof(MeshChunk));
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (level.status_fence != 0) glDeleteSync(level.status_fence);
+    level.status_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/**
+ * Check the status of a level's last generation if the GPU has finished it, without waiting for it. If a brick
+ * outgrew its chunk, the chunks are laid out again to fit and every brick is remeshed, which is checked on a later call.
+ * Otherwise the statistics are updated if the chunks of the viewport level were copied along with the status.
+ * 
+ * @param level The level of detail to check
+ * @param grid_resolution The simulation grid's resolution
+ * @param grid_texture OpenGL texture object refering to the 3D grid
+ */
+void MeshGenerator::poll_level_status(MeshLevel& level, int grid_resolution, GLuint grid_texture) {
+    if (level.status_fence == 0) return;
+    GLenum status = glClientWaitSync(level.status_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) return;
+    glDeleteSync(level.status_fence);
+    level.status_fence = 0;
+    if (status == GL_WAIT_FAILED) return;
+
+    level.remeshed_bricks = level.status->groups_x;
+    if (level.status->overflow == 0) {
+        if (level.status_has_chunks && &level == &levels[viewport_level]) gather_statistics(level);
+        return;
+    }
+
+    layout_chunks(level);
+    generate_level(level, grid_resolution, grid_texture, true);
+}
+
+/**
+ * Give every brick a chunk of the vertex and index buffers with room for its last extracted mesh plus some
+ * headroom, so that the pattern can grow for a while before the chunks have to be laid out again.
+ * 
+ * @param level The level of detail whose chunks to lay out
+ */
+void MeshGenerator::layout_chunks(MeshLevel& level) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<MeshChunk> chunks(level.chunk_count());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.chunks_ssbo);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, chunks.size() * sizeof(MeshChunk), chunks.data());
+
+    size_t vertex_count = 0;
+    size_t index_count = 0;
+    for (MeshChunk& chunk : chunks) {
+        chunk.first_vertex = vertex_count;
+        chunk.vertex_capacity = chunk.vertex_count + chunk.vertex_count / 2 + 16;
+        chunk.first_index = index_count;
+        chunk.index_capacity = chunk.index_count + chunk.index_count / 2 + 48;
+        vertex_count += chunk.vertex_capacity;
+        index_count += chunk.index_capacity;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.chunks_ssbo);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, chunks.size() * sizeof(MeshChunk), chunks.data());
+
+    GLuint overflow = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.dispatch_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(BrickDispatch, overflow), sizeof(GLuint), &overflow);
+
+    if (vertex_count > level.vertex_capacity) {
+        level.vertex_capacity = vertex_count;
+        glBindBuffer(GL_ARRAY_BUFFER, level.vbo);
+        glBufferData(GL_ARRAY_BUFFER, level.vertex_capacity * sizeof(MarchingCubeVertex), NULL, GL_DYNAMIC_DRAW);
+    }
+
+    if (index_count > level.index_capacity) {
+        level.index_capacity = index_count;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.ebo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, level.index_capacity * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+    }
+
+    upload_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Resize the mesh buffers of every resident level of detail to match the grid resolution.
  * 
  * @param grid_resolution The simulation grid's resolution
  */
 void MeshGenerator::resize(int grid_resolution) {
-	glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo);
-	glBufferData(GL_ARRAY_BUFFER, 15 * (grid_resolution / 2) * (grid_resolution / 2) * (grid_resolution / 2) * sizeof(MarchingCubeVertex), NULL, GL_DYNAMIC_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mesh_vbo);
+    for (MeshLevel& level : levels)
+        if (level.vao != 0) allocate_level(level, grid_resolution);
 }
 
 /**
- * Draw the generated mesh in 3D space.
+ * Remesh every brick of every level of detail when it is next generated, after a change to the isosurfaces.
+ */
+void MeshGenerator::remesh_all() {
+    for (MeshLevel& level : levels)
+        level.force_remesh = true;
+
+    // Remeshing leaves the levels' versions alone, so the smoothed viewport has to be told as well
+    smoothed_viewport.version = SmoothedViewport::outdated;
+    smoothed_viewport.uploaded_version = SmoothedViewport::outdated;
+}
+
+/**
+ * Draw the visible isosurfaces in 3D space. The smoothed surfaces lag behind the viewport mesh by up to
+ * smooth_interval frames, which is only accepted while the simulation is animating.
  * 
  * @param camera The camera to render in the perspective of
- * @param grid_resolution The simulation grid's resolution
+ * @param animating Whether the simulation is changing the grid every frame
  */
-void MeshGenerator::draw(OrbitalCamera& camera, int grid_resolution) {
+void MeshGenerator::draw(OrbitalCamera& camera, bool animating) {
+    MeshLevel& level = levels[viewport_level];
+    if (level.vao == 0) return;
+
     mesh_shader.bind();
 	glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(-0.5f, -0.5f, -0.5f));
     mesh_shader.set_mat4x4("model", model);
     mesh_shader.set_mat4x4("view_proj", camera.get_view_projection_matrix());
 
     glEnable(GL_CULL_FACE);
-    glBindVertexArray(mesh_vao);
-    glDrawArrays(GL_TRIANGLES, 0, 15 * grid_resolution * grid_resolution * grid_resolution);
+    const SmoothedViewport& smoothed = smoothed_viewport;
+    bool smoothed_current = animating || smoothed.uploaded_version == level.extracted_version;
+    if (smooth_viewport && smoothed_current && smoothed.uploaded_level == viewport_level && smoothed.uploaded_surfaces == level.surface_count) {
+        for (int i = 0; i < level.surface_count; i++) {
+            if (!isosurfaces[i].visible || smoothed.surfaces[i].index_count == 0) continue;
+            glBindVertexArray(smoothed.surfaces[i].vao);
+            glDrawElements(GL_TRIANGLES, smoothed.surfaces[i].index_count, GL_UNSIGNED_INT, 0);
+        }
+        return;
+    }
+
+    glBindVertexArray(level.vao);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, level.draw_commands_buffer);
+    for (int i = 0; i < level.surface_count; i++) {
+        if (!isosurfaces[i].visible) continue;
+        size_t first_command = (size_t)i * level.brick_count();
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(first_command * sizeof(DrawElementsCommand)), level.brick_count(), 0);
+    }
 }
 
 /**
- * Export the current state of the generated mesh to a .obj file.
+ * Extract, simplify and write the mesh of an export job, on its worker thread.
  * 
- * @param grid_resolution The simulation grid's resolution
+ * @param job The export job
+ * @param data The job's mapped staging buffer, holding either the field or the chunks, vertices and indices of a GPU mesh
  */
-void MeshGenerator::export_to_obj(int grid_resolution) {
-	glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo);
-	size_t sz = 15 * (grid_resolution / 2) * (grid_resolution / 2) * (grid_resolution / 2);
-	MarchingCubeVertex* ptr = new MarchingCubeVertex[sz];
-	glGetBufferSubData(GL_ARRAY_BUFFER, 0, sz * sizeof(MarchingCubeVertex), ptr);
-	
-	nfdchar_t *out_path = NULL;
-	nfdresult_t result = NFD_SaveDialog("obj", NULL, &out_path);
+static void run_export(ExportJob& job, const char* data) {
+	job.stage = ExportStage::Extracting;
+	MarchingCubesMesh mesh;
+
+	if (job.from_field) {
+		std::vector<float> field((size_t)job.grid_resolution * job.grid_resolution * job.grid_resolution);
+		std::memcpy(field.data(), data, field.size() * sizeof(float));
+
+		if (job.method == ExtractionMethod::SurfaceNets)
+			mesh = surface_nets(field, job.grid_resolution, job.threshold, job.step);
+		else
+			mesh = marching_cubes(field, job.grid_resolution, job.threshold, job.step);
+	} else {
+		const MeshChunk* chunks = (const MeshChunk*)data;
+		const MarchingCubeVertex* vertices = (const MarchingCubeVertex*)(data + job.brick_count * sizeof(MeshChunk));
+		const unsigned int* indices = (const unsigned int*)(data + job.brick_count * sizeof(MeshChunk) + job.vertex_capacity * sizeof(MarchingCubeVertex));
+		mesh = gather_chunks(chunks, job.brick_count, vertices, indices);
+
+		// Copies on shared faces are computed from the same values, so they are welded well within a thousandth of a cell
+		job.weld_result = weld_vertices(mesh, 0.001f / job.grid_resolution);
+	}
 
-	if (out_path == NULL) return;
-	std::string out_path_str = out_path;
+	if (job.smooth) {
+		job.stage = ExportStage::Smoothing;
+		smooth_mesh(mesh, job.smoothing);
+	}
 
-	if (out_path_str.size() < 4 || out_path_str.substr(out_path_str.size()-4, 4) != ".obj") out_path_str += ".obj";
-    std::ofstream objFile(out_path_str);
-    if (!objFile.is_open()) {
-        std::cerr << "Error opening export file '" << out_path << "'" << std::endl;
-        delete[] ptr;
-        return;
-    }
+	if (job.simplify) {
+		job.stage = ExportStage::Simplifying;
+		job.simplification_result = simplify_mesh(mesh, job.simplification);
+	}
 
-	std::vector<glm::vec3> positions;
-	std::vector<glm::vec3> normals;
-	std::vector<int> faceIndices;
+	job.stage = ExportStage::Writing;
+	job.written = write_mesh(mesh, job.path, job.format);
+	job.stage = ExportStage::Done;
+}
 
-	std::unordered_map<glm::vec3, int, std::hash<glm::vec3>> position_map;
-    std::unordered_map<glm::vec3, int, std::hash<glm::vec3>> normal_map;
+/**
+ * Copy one surface of a level's mesh into an export job's staging buffer behind a fence.
+ * 
+ * @param job The export job, whose surface is copied
+ * @param level The level of detail the surface was extracted at
+ */
+static void copy_level_mesh(ExportJob& job, const MeshLevel& level) {
+	job.brick_count = level.brick_count();
+	job.vertex_capacity = level.vertex_capacity;
+	job.index_capacity = level.index_capacity;
+
+	// Only the export surface's chunks are copied, while the vertex and index buffers are shared by every surface
+	GLintptr first_chunk_byte = (GLintptr)job.surface * job.brick_count * sizeof(MeshChunk);
+	GLsizeiptr chunk_bytes = job.brick_count * sizeof(MeshChunk);
+	GLsizeiptr vertex_bytes = job.vertex_capacity * sizeof(MarchingCubeVertex);
+	GLsizeiptr index_bytes = job.index_capacity * sizeof(unsigned int);
+	job.staging_size = chunk_bytes + vertex_bytes + index_bytes;
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, job.staging_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, job.staging_size, NULL, GL_STREAM_READ);
+	glBindBuffer(GL_COPY_READ_BUFFER, level.chunks_ssbo);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, first_chunk_byte, 0, chunk_bytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, level.vbo);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, chunk_bytes, vertex_bytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, level.ebo);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, chunk_bytes + vertex_bytes, index_bytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	job.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
 
-    for (size_t i = 0; i < sz; i++) {
-        glm::vec3 pos = ptr[i].pos - glm::vec3(0.5f, 0.5f, 0.5f);
-        glm::vec3 norm = ptr[i].normal;
+/**
+ * Start exporting the current state of the export surface in the background. The field is copied into a staging
+ * buffer without waiting for the GPU, while a GPU mesh is first remeshed in full, and the export carries on in update_export.
+ * 
+ * @param grid_resolution The simulation grid's resolution
+ * @param grid_texture OpenGL texture object refering to the 3D grid
+ */
+void MeshGenerator::export_mesh(int grid_resolution, GLuint grid_texture) {
+	if (export_job) return;
 
-        if (position_map.count(pos) == 0) {
-            position_map[pos] = positions.size();
-            positions.push_back(pos);
-        }
+	const char* extension = mesh_format_extension(export_format);
+	nfdchar_t *out_path = NULL;
+	nfdresult_t result = NFD_SaveDialog(extension, NULL, &out_path);
 
-        if (normal_map.count(norm) == 0) {
-            normal_map[norm] = normals.size();
-            normals.push_back(norm);
-        }
+	if (out_path == NULL) return;
+	std::string out_path_str = out_path;
+	free(out_path);
+
+	std::string suffix = std::string(".") + extension;
+	if (out_path_str.size() < suffix.size() || out_path_str.substr(out_path_str.size() - suffix.size()) != suffix) out_path_str += suffix;
+
+	MeshLevel& level = levels[export_level];
+	const Isosurface& surface = isosurfaces[export_surface];
+	export_job = std::make_unique<ExportJob>();
+	ExportJob& job = *export_job;
+	job.path = out_path_str;
+	job.format = export_format;
+	job.grid_resolution = grid_resolution;
+	job.step = level.step;
+	job.threshold = surface.threshold;
+	job.method = export_method;
+	job.from_field = cpu_export || export_method == ExtractionMethod::SurfaceNets;
+	job.smooth = smooth_export;
+	job.smoothing = smoothing;
+	job.simplify = simplify_export;
+	job.simplification.target_ratio = simplify_percent / 100.0f;
+	job.simplification.max_error = simplify_max_error / grid_resolution;
+
+	glGenBuffers(1, &job.staging_buffer);
+
+	if (job.from_field) {
+		job.staging_size = (GLsizeiptr)grid_resolution * grid_resolution * grid_resolution * sizeof(float);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, job.staging_buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, job.staging_size, NULL, GL_STREAM_READ);
+		glBindTexture(GL_TEXTURE_3D, grid_texture);
+		glGetTexImage(GL_TEXTURE_3D, 0, surface.channel == FieldChannel::U ? GL_RED : GL_GREEN, GL_FLOAT, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		job.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	} else {
+		// The export can't leave out overflowing bricks, so update_export copies the mesh once the GPU reports none
+		job.stage = ExportStage::Generating;
+		job.level = export_level;
+		job.surface = export_surface;
+		generate_level(level, grid_resolution, grid_texture, true);
+	}
+}
 
-        faceIndices.push_back(position_map[pos]);
-        faceIndices.push_back(normal_map[norm]);
-    }
+/**
+ * Move the background export along, called once per frame. A GPU mesh is copied into the staging buffer once its
+ * level reports that no brick overflowed, which may take a few frames of laying out and remeshing the chunks again.
+ * Once the staging copy has finished on the GPU, its buffer is mapped and handed to a worker thread, and once the
+ * worker is done the buffer is released.
+ * 
+ * @param grid_resolution The simulation grid's resolution
+ * @param grid_texture OpenGL texture object refering to the 3D grid
+ */
+void MeshGenerator::update_export(int grid_resolution, GLuint grid_texture) {
+	if (!export_job) return;
+	ExportJob& job = *export_job;
+
+	if (job.stage == ExportStage::Generating) {
+		MeshLevel& level = levels[job.level];
+		poll_level_status(level, grid_resolution, grid_texture);
+		if (level.status_fence != 0) return;
+
+		if (job.surface >= level.surface_count) {
+			std::cerr << "[ERROR] The export surface was removed before its mesh was extracted" << std::endl;
+			glDeleteBuffers(1, &job.staging_buffer);
+			last_export_failed = true;
+			export_job.reset();
+			return;
+		}
+		copy_level_mesh(job, level);
+		job.stage = ExportStage::Copying;
+		return;
+	}
 
-	for (int i = 0; i < positions.size(); i++)
-		objFile << "v " << positions[i].x << " " << positions[i].y << " " << positions[i].z << "\n";
+	if (job.fence != 0) {
+		GLenum status = glClientWaitSync(job.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_TIMEOUT_EXPIRED) return;
+		glDeleteSync(job.fence);
+		job.fence = 0;
+
+		const char* data = NULL;
+		if (status != GL_WAIT_FAILED) {
+			glBindBuffer(GL_COPY_READ_BUFFER, job.staging_buffer);
+			data = (const char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, job.staging_size, GL_MAP_READ_BIT);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		if (data == NULL) {
+			std::cerr << "[ERROR] Failed to read back the mesh for export" << std::endl;
+			glDeleteBuffers(1, &job.staging_buffer);
+			last_export_failed = true;
+			export_job.reset();
+			return;
+		}
+
+		job.worker = std::thread(run_export, std::ref(job), data);
+		return;
+	}
 
-	for (int i = 0; i < normals.size(); i++)
-		objFile << "vn " << normals[i].x << " " << normals[i].y << " " << normals[i].z << "\n";
+	if (job.stage != ExportStage::Done) return;
+	job.worker.join();
 
-	for (int i = 0; i < faceIndices.size(); i += 6) {
-		glm::vec3 A = positions[faceIndices[i]];
-		glm::vec3 B = positions[faceIndices[i+2]];
-		glm::vec3 C = positions[faceIndices[i+4]];
-		float a = glm::length(B - C);
-		float b = glm::length(A - C);
-		float c = glm::length(A - B);
-		float s = 0.5 * (a + b + c);
-		float area = sqrt(s * (s - a) * (s - b) * (s - c));
-		if (area <= 0) continue;
+	glBindBuffer(GL_COPY_READ_BUFFER, job.staging_buffer);
+	glUnmapBuffer(GL_COPY_READ_BUFFER);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glDeleteBuffers(1, &job.staging_buffer);
 
-		objFile << "f " << faceIndices[i]+1 << "//" << faceIndices[i+1]+1 << " "; 
-		objFile << faceIndices[i+2]+1 << "//" << faceIndices[i+3]+1 << " "; 
-		objFile << faceIndices[i+4]+1 << "//" << faceIndices[i+5]+1 << "\n"; 
-	}
+	last_export_failed = !job.written;
+	if (job.simplify) last_simplification = job.simplification_result;
+	if (!job.from_field) last_weld = job.weld_result;
+	export_job.reset();
+}
 
-    objFile.close();
+/**
+ * Record the surface into the current sequence when a frame is due, called once per frame.
+ * 
+ * @param grid_resolution The simulation grid's resolution
+ * @param grid_texture OpenGL texture object refering to the 3D grid
+ * @param time_steps The number of time steps simulated since the grid was last cleared
+ */
+void MeshGenerator::record_sequence(int grid_resolution, GLuint grid_texture, unsigned long long time_steps) {
+	recorder.update(grid_resolution, grid_texture, time_steps);
+}
+
+/**
+ * Check whether an export or the end of a sequence recording is still running, which needs update_export
+ * and record_sequence to be called every frame.
+ */
+bool MeshGenerator::is_exporting() const {
+	return export_job != nullptr || recorder.has_pending_work();
+}
 
-    delete[] ptr;
+/**
+ * Check whether anything is still running that needs generate, update_export and record_sequence to be called
+ * every frame, even while the simulation is paused.
+ */
+bool MeshGenerator::has_pending_work() const {
+	const MeshLevel& level = levels[viewport_level];
+	const SmoothedViewport& smoothed = smoothed_viewport;
+	bool smoothing = smooth_viewport && (smoothed.fence != 0 || smoothed.worker.joinable()
+		|| smoothed.level != viewport_level || smoothed.version != level.extracted_version);
+	return is_exporting() || level.status_fence != 0 || smoothing;
 }
 
 /**
  * Draw the GUI section that allows for manipulation of the simulation's mesh generation.
  * 
  * @param grid_resolution The simulation grid's resolution
+ * @param grid_texture OpenGL texture object refering to the 3D grid
  */
-void MeshGenerator::draw_gui(int grid_resolution) {
-	if (ImGui::Button("Export Mesh as .obj")) export_to_obj(grid_resolution);
-	ImGui::SliderFloat("Threshold", &threshold, 0.0f, 1.0f);
+void MeshGenerator::draw_gui(int grid_resolution, GLuint grid_texture) {
+	const char* steps[] = {"1 (Full Resolution)", "2", "4", "8"};
+	const char* method_names[] = {"Marching Cubes", "Surface Nets"};
+	const char* format_names[] = {"OBJ", "PLY (Binary)", "STL (Binary)", "GLB"};
+
+	if (export_job) {
+		const char* stage_names[] = {"Extracting on GPU", "Copying from GPU", "Extracting", "Smoothing", "Simplifying", "Writing", "Done"};
+		ExportStage stage = export_job->stage;
+		ImGui::ProgressBar((float)(int)stage / (int)ExportStage::Done, ImVec2(-1.0f, 0.0f), stage_names[(int)stage]);
+	} else if (ImGui::Button("Export Mesh")) {
+		export_mesh(grid_resolution, grid_texture);
+	}
+	if (!export_job && last_export_failed) {
+		ImGui::SameLine();
+		ImGui::Text("Export failed");
+	}
+	int format = (int)export_format;
+	if (ImGui::Combo("Export Format", &format, format_names, 4))
+		export_format = (MeshFormat)format;
+	ImGui::Combo("Export Step", &export_level, steps, 4);
+	int method = (int)export_method;
+	if (ImGui::Combo("Export Method", &method, method_names, 2))
+		export_method = (ExtractionMethod)method;
+	if (export_method == ExtractionMethod::MarchingCubes)
+		ImGui::Checkbox("Export on CPU", &cpu_export);
+	if (last_weld.seconds > 0.0) {
+		ImGui::Text("Last Weld: %zu -> %zu vertices at %.1f Mvertices/s", last_weld.vertices_before,
+			last_weld.vertices_after, last_weld.vertices_before / last_weld.seconds / 1e6);
+	}
+	ImGui::Checkbox("Simplify Before Export", &simplify_export);
+	if (simplify_export) {
+		ImGui::SliderFloat("Keep Triangles (%)", &simplify_percent, 1.0f, 100.0f);
+		ImGui::SliderFloat("Max Error (cells)", &simplify_max_error, 0.0f, 4.0f);
+		if (last_simplification.triangles_before > 0) {
+			ImGui::Text("Last: %zu -> %zu triangles in %.2f s", last_simplification.triangles_before,
+				last_simplification.triangles_after, last_simplification.seconds);
+		}
+	}
+	if (recorder.is_recording()) {
+		if (ImGui::Button("Stop Recording")) recorder.stop();
+	} else if (!recorder.has_pending_work() && ImGui::Button("Record Sequence")) {
+		nfdchar_t *out_path = NULL;
+		NFD_SaveDialog("rd3dseq", NULL, &out_path);
+		if (out_path != NULL) {
+			std::string out_path_str = out_path;
+			free(out_path);
+			if (out_path_str.size() < 8 || out_path_str.substr(out_path_str.size() - 8) != ".rd3dseq") out_path_str += ".rd3dseq";
+			const Isosurface& surface = isosurfaces[export_surface];
+			recorder.start(out_path_str, grid_resolution, levels[export_level].step, surface.channel == FieldChannel::U ? GL_RED : GL_GREEN, surface.threshold, record_interval);
+		}
+	}
+	ImGui::InputInt("Record Every (steps)", &record_interval);
+	record_interval = std::max(record_interval, 1);
+	recorder.draw_gui();
+	ImGui::Combo("Viewport Step", &viewport_level, steps, 4);
+	bool smoothing_changed = false;
+	ImGui::Checkbox("Smooth Export", &smooth_export);
+	smoothing_changed |= ImGui::Checkbox("Smooth Viewport", &smooth_viewport);
+	if (smooth_export || smooth_viewport) {
+		smoothing_changed |= ImGui::SliderInt("Smoothing Iterations", &smoothing.iterations, 1, 50);
+		smoothing_changed |= ImGui::SliderFloat("Smoothing Lambda", &smoothing.lambda, 0.0f, 1.0f);
+		smoothing_changed |= ImGui::SliderFloat("Smoothing Mu", &smoothing.mu, -1.0f, 0.0f);
+		if (smooth_viewport) ImGui::SliderInt("Smooth Every (frames)", &smooth_interval, 1, 120);
+	}
+
+	// Resmooth the viewport mesh as soon as the smoothing changes
+	if (smoothing_changed) smoothed_viewport.version = SmoothedViewport::outdated;
+	ImGui::SliderFloat("Remesh Tolerance", &remesh_tolerance, 0.0f, 0.05f);
+
+	const char* channel_names[] = {"u", "v"};
+	bool surfaces_changed = false;
+	for (size_t i = 0; i < isosurfaces.size(); i++) {
+		Isosurface& surface = isosurfaces[i];
+		ImGui::PushID((int)i);
+		ImGui::Text("Surface %zu", i + 1);
+		ImGui::SameLine();
+		ImGui::Checkbox("Visible", &surface.visible);
+		int channel = (int)surface.channel;
+		if (ImGui::Combo("Chemical", &channel, channel_names, 2)) {
+			surface.channel = (FieldChannel)channel;
+			surfaces_changed = true;
+		}
+		surfaces_changed |= ImGui::SliderFloat("Threshold", &surface.threshold, 0.0f, 1.0f);
+		if (isosurfaces.size() > 1 && ImGui::Button("Remove Surface")) {
+			isosurfaces.erase(isosurfaces.begin() + i);
+			surfaces_changed = true;
+			ImGui::PopID();
+			break;
+		}
+		ImGui::PopID();
+	}
+	if (isosurfaces.size() < max_isosurfaces && ImGui::Button("Add Surface")) {
+		isosurfaces.push_back(isosurfaces.back());
+		surfaces_changed = true;
+	}
+	export_surface = std::min(export_surface, (int)isosurfaces.size() - 1);
+	int export_number = export_surface + 1;
+	if (ImGui::SliderInt("Export Surface", &export_number, 1, isosurfaces.size()))
+		export_surface = export_number - 1;
+	if (surfaces_changed) remesh_all();
+
+	// Counts gathered before the statistics were hidden may be out of date, so they are gathered again
+	if (ImGui::Checkbox("Show Statistics", &collect_statistics) && collect_statistics) statistics.step = 0;
+	if (collect_statistics) {
+		const MeshStatistics& stats = statistics;
+		ImGui::Text("Bricks: %zu (%zu remeshed)", stats.bricks, stats.remeshed_bricks);
+		ImGui::Text("Active Cells: %zu", stats.active_cells);
+		ImGui::Text("Vertices: %zu, Triangles: %zu", stats.vertices, stats.triangles);
+		for (size_t i = 0; i < stats.surface_triangles.size(); i++)
+			ImGui::Text("  Surface %zu: %zu triangles", i + 1, stats.surface_triangles[i]);
+		ImGui::Text("Vertex Buffer: %.2f / %.2f MiB", stats.vertex_bytes_used / 1048576.0, stats.vertex_bytes_allocated / 1048576.0);
+		ImGui::Text("Index Buffer: %.2f / %.2f MiB", stats.index_bytes_used / 1048576.0, stats.index_bytes_allocated / 1048576.0);
+		ImGui::Text("Brick Tables: %.2f MiB", stats.brick_bytes_allocated / 1048576.0);
+		if (stats.bytes_allocated() > 0)
+			ImGui::ProgressBar((float)stats.bytes_used() / stats.bytes_allocated(), ImVec2(-1.0f, 0.0f), "Buffer Utilization");
+		ImGui::Text("Extraction: %.3f ms GPU, %.3f ms CPU", stats.extraction_ms, stats.generate_ms);
+		ImGui::Text("Upload: %.3f ms", stats.upload_ms);
+		if (ImGui::Button("Copy Statistics as JSON"))
+			ImGui::SetClipboardText(stats.to_json().c_str());
+	}
 }
 
 /**
- * Initialize the OpenGL objects and buffers that allow for mesh generation and rendering.
+ * Create or resize the buffers of a level of detail. Every brick starts out with an empty chunk,
+ * so the chunks are laid out to fit the first mesh that is generated.
  * 
+ * @param level The level of detail to allocate
  * @param grid_resolution The simulation grid's resolution
  */
-void MeshGenerator::init_buffers(int grid_resolution) {
-	glGenVertexArrays(1, &mesh_vao);
-	glBindVertexArray(mesh_vao);
-
-	glGenBuffers(1, &mesh_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh_vbo);
-	glBufferData(GL_ARRAY_BUFFER, 15 * (grid_resolution / 2) * (grid_resolution / 2) * (grid_resolution / 2) * sizeof(MarchingCubeVertex), NULL, GL_DYNAMIC_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mesh_vbo);
+void MeshGenerator::allocate_level(MeshLevel& level, int grid_resolution) {
+	if (level.vao == 0) {
+		glGenVertexArrays(1, &level.vao);
+		glGenBuffers(1, &level.vbo);
+		glGenBuffers(1, &level.ebo);
+		glGenBuffers(1, &level.dirty_bricks_ssbo);
+		glGenBuffers(1, &level.dispatch_buffer);
+		glGenBuffers(1, &level.extracted_values_ssbo);
+		glGenBuffers(1, &level.chunks_ssbo);
+		glGenBuffers(1, &level.draw_commands_buffer);
+
+		glBindVertexArray(level.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, level.vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.ebo);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MarchingCubeVertex), (void*)0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MarchingCubeVertex), (void*)offsetof(MarchingCubeVertex, normal));
+		glEnableVertexAttribArray(1);
+		glBindVertexArray(0);
+
+		BrickDispatch dispatch = {0, 1, 1, 0};
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.dispatch_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(BrickDispatch), &dispatch, GL_DYNAMIC_DRAW);
+	}
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MarchingCubeVertex), (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MarchingCubeVertex), (void*)offsetof(MarchingCubeVertex, normal));
-	glEnableVertexAttribArray(1);
+	level.cells_per_axis = (grid_resolution - 1) / level.step;
+	level.bricks_per_axis = (level.cells_per_axis + MeshLevel::brick_cells - 1) / MeshLevel::brick_cells;
+	level.surface_count = isosurfaces.size();
+	level.vertex_capacity = 0;
+	level.index_capacity = 0;
+	level.force_remesh = true;
+
+	std::vector<MeshChunk> chunks(level.chunk_count(), MeshChunk{});
+	std::vector<DrawElementsCommand> draw_commands(level.chunk_count(), DrawElementsCommand{});
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.chunks_ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, chunks.size() * sizeof(MeshChunk), chunks.data(), GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.draw_commands_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, draw_commands.size() * sizeof(DrawElementsCommand), draw_commands.data(), GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.dirty_bricks_ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, level.brick_count() * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.extracted_values_ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, level.brick_count() * 512 * 2 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+
+	// The status buffer's storage is immutable, so it is made again with room for the new number of chunks,
+	// and any status still pending describes the old layout
+	if (level.status_fence != 0) glDeleteSync(level.status_fence);
+	level.status_fence = 0;
+	if (level.status_buffer != 0) glDeleteBuffers(1, &level.status_buffer);
+
+	GLsizeiptr status_size = sizeof(BrickDispatch) + chunks.size() * sizeof(MeshChunk);
+	GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &level.status_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, level.status_buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, status_size, NULL, flags);
+	const char* status = (const char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, status_size, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	level.status = (const BrickDispatch*)status;
+	level.status_chunks = (const MeshChunk*)(status + sizeof(BrickDispatch));
 }
 
 /**
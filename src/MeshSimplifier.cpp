@@ -0,0 +1,466 @@
+#include "MeshSimplifier.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+
+using namespace RD3D;
+
+// Meshes are split into regions of about this many triangles which are simplified in parallel
+static constexpr size_t triangles_per_region = 16384;
+
+static constexpr uint32_t no_vertex = UINT32_MAX;
+
+namespace {
+    /**
+     * The sum of squared distances to a set of planes, stored as the upper triangle of a symmetric 4x4 matrix.
+     */
+    struct Quadric {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+        static Quadric plane(glm::dvec3 n, double d) {
+            return {n.x * n.x, n.x * n.y, n.x * n.z, n.x * d, n.y * n.y, n.y * n.z, n.y * d, n.z * n.z, n.z * d, d * d};
+        }
+
+        Quadric& operator+=(const Quadric& q) {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+            bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+            return *this;
+        }
+
+        double error(glm::dvec3 p) const {
+            return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+                 + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+                 + c2 * p.z * p.z + 2 * cd * p.z + d2;
+        }
+
+        // Find the point of least error, which fails when the planes do not pin down a single point
+        bool minimum(glm::dvec3& p) const {
+            // Cramer's rule on the symmetric 3x3 system
+            double c00 = b2 * c2 - bc * bc;
+            double c01 = bc * ac - ab * c2;
+            double c02 = ab * bc - b2 * ac;
+            double det = a2 * c00 + ab * c01 + ac * c02;
+            if (std::abs(det) < 1e-12) return false;
+
+            double c11 = a2 * c2 - ac * ac;
+            double c12 = ab * ac - a2 * bc;
+            double c22 = a2 * b2 - ab * ab;
+            p = glm::dvec3(
+                -(c00 * ad + c01 * bd + c02 * cd),
+                -(c01 * ad + c11 * bd + c12 * cd),
+                -(c02 * ad + c12 * bd + c22 * cd)
+            ) / det;
+            return true;
+        }
+    };
+
+    struct Collapse {
+        double cost;
+        uint32_t v0, v1;
+        uint32_t stamp0, stamp1;
+        glm::vec3 position;
+
+        bool operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    /**
+     * Quadric error edge collapse over an indexed mesh. Collapsed vertices are merged into the vertex they collapse onto
+     * like a union-find, so triangles keep their original indices and are resolved through find(). A vertex's group is the
+     * chain of every vertex merged into it, and its triangles are the live ones listed by any member of the group.
+     */
+    class Simplifier {
+    public:
+        Simplifier(MarchingCubesMesh& mesh);
+
+        size_t live_triangles() const;
+        void simplify_regions(float target_ratio, double max_cost);
+        void simplify_borders(size_t target_triangles, double max_cost);
+        void write_back(MarchingCubesMesh& mesh);
+    private:
+        std::vector<glm::vec3> positions;
+        std::vector<glm::uvec3> triangles;
+        std::vector<uint8_t> triangle_alive;
+        std::vector<int> triangle_region;
+
+        std::vector<uint32_t> vertex_triangle_offsets;
+        std::vector<uint32_t> vertex_triangles;
+
+        std::vector<uint32_t> parent;
+        std::vector<uint32_t> next_in_group;
+        std::vector<uint32_t> group_tail;
+        std::vector<uint32_t> stamps;
+        std::vector<Quadric> quadrics;
+        std::vector<int> vertex_region;
+        std::vector<uint8_t> locked;
+        std::vector<uint8_t> on_mesh_border;
+        int region_count = 1;
+
+        uint32_t find(uint32_t v);
+        glm::uvec3 resolve(uint32_t t);
+        template <typename F> void for_each_triangle(uint32_t v, F fn);
+        void neighbours(uint32_t v, std::vector<uint32_t>& out);
+        Collapse plan_collapse(uint32_t v0, uint32_t v1);
+        bool can_collapse(const Collapse& c, std::vector<uint32_t>& scratch0, std::vector<uint32_t>& scratch1);
+        size_t apply_collapse(const Collapse& c);
+        void simplify(const std::vector<uint32_t>& vertices, int region, size_t live, size_t target, double max_cost);
+    };
+}
+
+Simplifier::Simplifier(MarchingCubesMesh& mesh) {
+    size_t vertex_count = mesh.vertices.size();
+    size_t triangle_count = mesh.indices.size() / 3;
+
+    positions.resize(vertex_count);
+    for (size_t i = 0; i < vertex_count; i++)
+        positions[i] = mesh.vertices[i].pos;
+
+    triangles.resize(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++)
+        triangles[t] = glm::uvec3(mesh.indices[3 * t], mesh.indices[3 * t + 1], mesh.indices[3 * t + 2]);
+    triangle_alive.assign(triangle_count, 1);
+
+    // Vertex to triangle adjacency in compressed rows
+    vertex_triangle_offsets.assign(vertex_count + 1, 0);
+    for (const glm::uvec3& tri : triangles)
+        for (int k = 0; k < 3; k++) vertex_triangle_offsets[tri[k] + 1]++;
+    for (size_t v = 0; v < vertex_count; v++)
+        vertex_triangle_offsets[v + 1] += vertex_triangle_offsets[v];
+    vertex_triangles.resize(vertex_triangle_offsets[vertex_count]);
+    std::vector<uint32_t> fill(vertex_triangle_offsets.begin(), vertex_triangle_offsets.end() - 1);
+    for (size_t t = 0; t < triangle_count; t++)
+        for (int k = 0; k < 3; k++) vertex_triangles[fill[triangles[t][k]]++] = t;
+
+    parent.resize(vertex_count);
+    next_in_group.assign(vertex_count, no_vertex);
+    group_tail.resize(vertex_count);
+    for (uint32_t v = 0; v < vertex_count; v++)
+        parent[v] = group_tail[v] = v;
+    stamps.assign(vertex_count, 0);
+
+    // Split the bounding box into a fixed number of regions, independent of the thread count so the result is deterministic
+    glm::vec3 lo(positions.empty() ? glm::vec3(0.0f) : positions[0]), hi = lo;
+    for (const glm::vec3& p : positions) {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    int regions_per_axis = std::clamp((int)std::cbrt((double)triangle_count / triangles_per_region), 1, 32);
+    region_count = regions_per_axis * regions_per_axis * regions_per_axis;
+    glm::vec3 extent = glm::max(hi - lo, glm::vec3(1e-6f));
+
+    triangle_region.resize(triangle_count);
+    ThreadPool::get().parallel_for(0, (int)((triangle_count + 4095) / 4096), [&](int block) {
+        size_t end = std::min(triangle_count, (size_t)(block + 1) * 4096);
+        for (size_t t = (size_t)block * 4096; t < end; t++) {
+            glm::vec3 centroid = (positions[triangles[t].x] + positions[triangles[t].y] + positions[triangles[t].z]) / 3.0f;
+            glm::ivec3 cell = glm::clamp(glm::ivec3((centroid - lo) / extent * (float)regions_per_axis), glm::ivec3(0), glm::ivec3(regions_per_axis - 1));
+            triangle_region[t] = cell.x + cell.y * regions_per_axis + cell.z * regions_per_axis * regions_per_axis;
+        }
+    });
+
+    // Each vertex gets the sum of the planes of its triangles, and vertices whose triangles span several regions or that
+    // lie on an open edge of the mesh are locked during the parallel pass
+    quadrics.resize(vertex_count);
+    vertex_region.assign(vertex_count, 0);
+    locked.assign(vertex_count, 0);
+    on_mesh_border.assign(vertex_count, 0);
+
+    ThreadPool::get().parallel_for(0, (int)((vertex_count + 4095) / 4096), [&](int block) {
+        std::vector<uint32_t> ring;
+        size_t end = std::min(vertex_count, (size_t)(block + 1) * 4096);
+
+        for (size_t v = (size_t)block * 4096; v < end; v++) {
+            uint32_t first = vertex_triangle_offsets[v];
+            uint32_t last = vertex_triangle_offsets[v + 1];
+            if (first == last) continue;
+
+            vertex_region[v] = triangle_region[vertex_triangles[first]];
+            ring.clear();
+
+            for (uint32_t i = first; i < last; i++) {
+                uint32_t t = vertex_triangles[i];
+                const glm::uvec3& tri = triangles[t];
+                if (triangle_region[t] != vertex_region[v]) locked[v] = 1;
+
+                glm::dvec3 a(positions[tri.x]), b(positions[tri.y]), c(positions[tri.z]);
+                glm::dvec3 n = glm::cross(b - a, c - a);
+                double length = glm::length(n);
+                if (length > 0.0) {
+                    n /= length;
+                    quadrics[v] += Quadric::plane(n, -glm::dot(n, a));
+                }
+
+                for (int k = 0; k < 3; k++)
+                    if (tri[k] != v) ring.push_back(tri[k]);
+            }
+
+            // On a closed surface every neighbour is shared by exactly two of the vertex's triangles
+            std::sort(ring.begin(), ring.end());
+            for (size_t i = 0; i < ring.size();) {
+                size_t j = i;
+                while (j < ring.size() && ring[j] == ring[i]) j++;
+                if (j - i != 2) on_mesh_border[v] = 1;
+                i = j;
+            }
+            if (on_mesh_border[v]) locked[v] = 1;
+        }
+    });
+}
+
+size_t Simplifier::live_triangles() const {
+    return std::count(triangle_alive.begin(), triangle_alive.end(), 1);
+}
+
+uint32_t Simplifier::find(uint32_t v) {
+    uint32_t root = v;
+    while (parent[root] != root) root = parent[root];
+    while (parent[v] != root) {
+        uint32_t next = parent[v];
+        parent[v] = root;
+        v = next;
+    }
+    return root;
+}
+
+glm::uvec3 Simplifier::resolve(uint32_t t) {
+    return glm::uvec3(find(triangles[t].x), find(triangles[t].y), find(triangles[t].z));
+}
+
+template <typename F>
+void Simplifier::for_each_triangle(uint32_t v, F fn) {
+    for (uint32_t member = v; member != no_vertex; member = next_in_group[member])
+        for (uint32_t i = vertex_triangle_offsets[member]; i < vertex_triangle_offsets[member + 1]; i++)
+            if (triangle_alive[vertex_triangles[i]]) fn(vertex_triangles[i]);
+}
+
+void Simplifier::neighbours(uint32_t v, std::vector<uint32_t>& out) {
+    out.clear();
+    for_each_triangle(v, [&](uint32_t t) {
+        glm::uvec3 tri = resolve(t);
+        for (int k = 0; k < 3; k++)
+            if (tri[k] != v) out.push_back(tri[k]);
+    });
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+Collapse Simplifier::plan_collapse(uint32_t v0, uint32_t v1) {
+    Quadric q = quadrics[v0];
+    q += quadrics[v1];
+
+    glm::dvec3 p;
+    if (!q.minimum(p)) {
+        // Fall back to the best of the edge's ends and midpoint
+        glm::dvec3 candidates[3] = {glm::dvec3(positions[v0]), glm::dvec3(positions[v1]), (glm::dvec3(positions[v0]) + glm::dvec3(positions[v1])) * 0.5};
+        p = candidates[0];
+        for (int i = 1; i < 3; i++)
+            if (q.error(candidates[i]) < q.error(p)) p = candidates[i];
+    }
+
+    return {std::max(q.error(p), 0.0), v0, v1, stamps[v0], stamps[v1], glm::vec3(p)};
+}
+
+bool Simplifier::can_collapse(const Collapse& c, std::vector<uint32_t>& scratch0, std::vector<uint32_t>& scratch1) {
+    // The edge's two triangles must be the only ones whose corners are both shared neighbours, or the collapse would pinch the surface
+    neighbours(c.v0, scratch0);
+    neighbours(c.v1, scratch1);
+    size_t shared = 0;
+    for (size_t i = 0, j = 0; i < scratch0.size() && j < scratch1.size();) {
+        if (scratch0[i] < scratch1[j]) i++;
+        else if (scratch0[i] > scratch1[j]) j++;
+        else { shared++; i++; j++; }
+    }
+    if (shared != 2) return false;
+
+    // No surviving triangle may flip over
+    bool valid = true;
+    auto check = [&](uint32_t t) {
+        if (!valid) return;
+        glm::uvec3 tri = resolve(t);
+        bool has0 = tri.x == c.v0 || tri.y == c.v0 || tri.z == c.v0;
+        bool has1 = tri.x == c.v1 || tri.y == c.v1 || tri.z == c.v1;
+        if (has0 && has1) return;
+
+        glm::vec3 before[3], after[3];
+        for (int k = 0; k < 3; k++) {
+            before[k] = positions[tri[k]];
+            after[k] = (tri[k] == c.v0 || tri[k] == c.v1) ? c.position : before[k];
+        }
+        glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+        glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+        if (glm::dot(n0, n1) <= 0.0f) valid = false;
+    };
+    for_each_triangle(c.v0, check);
+    for_each_triangle(c.v1, check);
+    return valid;
+}
+
+size_t Simplifier::apply_collapse(const Collapse& c) {
+    size_t removed = 0;
+    for_each_triangle(c.v1, [&](uint32_t t) {
+        glm::uvec3 tri = resolve(t);
+        if (tri.x == c.v0 || tri.y == c.v0 || tri.z == c.v0) {
+            triangle_alive[t] = 0;
+            removed++;
+        }
+    });
+
+    parent[c.v1] = c.v0;
+    next_in_group[group_tail[c.v0]] = c.v1;
+    group_tail[c.v0] = group_tail[c.v1];
+
+    positions[c.v0] = c.position;
+    quadrics[c.v0] += quadrics[c.v1];
+    stamps[c.v0]++;
+    stamps[c.v1]++;
+    return removed;
+}
+
+/**
+ * Collapse the cheapest edges between the given vertices until the live triangle count reaches the target or
+ * the next collapse would cost more than the bound.
+ */
+void Simplifier::simplify(const std::vector<uint32_t>& vertices, int region, size_t live, size_t target, double max_cost) {
+    auto eligible = [&](uint32_t v) {
+        return !locked[v] && (region < 0 || vertex_region[v] == region);
+    };
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+    std::vector<uint32_t> ring, scratch0, scratch1;
+
+    for (uint32_t v : vertices) {
+        if (find(v) != v || !eligible(v)) continue;
+        neighbours(v, ring);
+        for (uint32_t u : ring)
+            if (u > v && eligible(u)) queue.push(plan_collapse(v, u));
+    }
+
+    while (live > target && !queue.empty()) {
+        Collapse c = queue.top();
+        queue.pop();
+
+        if (max_cost > 0.0 && c.cost > max_cost) break;
+        if (parent[c.v0] != c.v0 || parent[c.v1] != c.v1) continue;
+        if (stamps[c.v0] != c.stamp0 || stamps[c.v1] != c.stamp1) continue;
+        if (!can_collapse(c, scratch0, scratch1)) continue;
+
+        live -= apply_collapse(c);
+
+        neighbours(c.v0, ring);
+        for (uint32_t u : ring)
+            if (eligible(u)) queue.push(plan_collapse(c.v0, u));
+    }
+}
+
+/**
+ * Simplify every region in parallel down to the target ratio of its triangles. Regions never touch each other's
+ * vertices since every vertex whose triangles span several regions is locked.
+ */
+void Simplifier::simplify_regions(float target_ratio, double max_cost) {
+    std::vector<std::vector<uint32_t>> region_vertices(region_count);
+    std::vector<size_t> region_triangles(region_count, 0);
+    for (uint32_t v = 0; v < positions.size(); v++)
+        if (!locked[v] && vertex_triangle_offsets[v] != vertex_triangle_offsets[v + 1]) region_vertices[vertex_region[v]].push_back(v);
+    for (int region : triangle_region)
+        region_triangles[region]++;
+
+    ThreadPool::get().parallel_for(0, region_count, [&](int region) {
+        size_t live = region_triangles[region];
+        size_t target = (size_t)std::ceil(live * (double)target_ratio);
+        simplify(region_vertices[region], region, live, target, max_cost);
+    });
+}
+
+/**
+ * Finish the simplification over the whole mesh, now that the vertices along region borders can be collapsed too.
+ * The interior of every region has already been simplified, so only the edges of the previously locked vertices are queued.
+ */
+void Simplifier::simplify_borders(size_t target_triangles, double max_cost) {
+    size_t live = live_triangles();
+    if (live <= target_triangles) return;
+
+    std::vector<uint32_t> vertices;
+    for (uint32_t v = 0; v < positions.size(); v++) {
+        if (locked[v] && !on_mesh_border[v]) vertices.push_back(v);
+        locked[v] = on_mesh_border[v];
+    }
+
+    simplify(vertices, -1, live, target_triangles, max_cost);
+}
+
+/**
+ * Replace the mesh with the simplified one, giving every remaining vertex a normal averaged from its triangles.
+ */
+void Simplifier::write_back(MarchingCubesMesh& mesh) {
+    std::vector<uint32_t> remap(positions.size(), no_vertex);
+    std::vector<uint32_t> roots;
+    for (uint32_t v = 0; v < positions.size(); v++) {
+        if (find(v) != v) continue;
+        bool used = false;
+        for_each_triangle(v, [&](uint32_t) { used = true; });
+        if (!used) continue;
+
+        remap[v] = roots.size();
+        roots.push_back(v);
+    }
+
+    // Every path was compressed by find() above, so each vertex's parent is now its root
+    mesh.vertices.resize(roots.size());
+    ThreadPool::get().parallel_for(0, (int)((roots.size() + 4095) / 4096), [&](int block) {
+        size_t end = std::min(roots.size(), (size_t)(block + 1) * 4096);
+        for (size_t i = (size_t)block * 4096; i < end; i++) {
+            uint32_t v = roots[i];
+            glm::vec3 normal(0.0f);
+            for_each_triangle(v, [&](uint32_t t) {
+                glm::uvec3 tri = triangles[t];
+                glm::vec3 a = positions[parent[tri.x]], b = positions[parent[tri.y]], c = positions[parent[tri.z]];
+                normal += glm::cross(b - a, c - a);
+            });
+
+            float length = glm::length(normal);
+            mesh.vertices[i].pos = positions[v];
+            mesh.vertices[i].normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        }
+    });
+
+    mesh.indices.clear();
+    for (size_t t = 0; t < triangles.size(); t++) {
+        if (!triangle_alive[t]) continue;
+        glm::uvec3 tri = resolve(t);
+        for (int k = 0; k < 3; k++)
+            mesh.indices.push_back(remap[tri[k]]);
+    }
+}
+
+/**
+ * Reduce the triangle count of a welded mesh by quadric error edge collapse. The mesh is split into spatial regions which are
+ * simplified in parallel with the vertices along their borders locked, and a final pass over the whole mesh then collapses
+ * across the borders to reach the target. Open edges of the mesh, such as where the surface meets the side of the grid, are kept.
+ *
+ * @param mesh The welded mesh to simplify in place
+ * @param settings The target triangle ratio and error bound
+ * @return The triangle counts before and after simplification and the time it took
+ */
+SimplificationResult RD3D::simplify_mesh(MarchingCubesMesh& mesh, const SimplificationSettings& settings) {
+    auto start = std::chrono::steady_clock::now();
+
+    SimplificationResult result;
+    result.triangles_before = mesh.indices.size() / 3;
+
+    size_t target = (size_t)std::ceil(result.triangles_before * (double)settings.target_ratio);
+    double max_cost = (double)settings.max_error * settings.max_error;
+
+    if (target < result.triangles_before) {
+        Simplifier simplifier(mesh);
+        simplifier.simplify_regions(settings.target_ratio, max_cost);
+        simplifier.simplify_borders(target, max_cost);
+        simplifier.write_back(mesh);
+    }
+
+    result.triangles_after = mesh.indices.size() / 3;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,131 @@
+#include "MeshSmoother.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+using namespace RD3D;
+
+// Vertices handled by one task of every parallel pass
+static constexpr size_t block_size = 1 << 14;
+
+/**
+ * Run a function over every index in [0, count) in parallel, in fixed blocks of indices.
+ */
+template <typename Fn>
+static void parallel_over(size_t count, Fn fn) {
+    int blocks = (count + block_size - 1) / block_size;
+    ThreadPool::get().parallel_for(0, blocks, [&](int block) {
+        size_t end = std::min(count, (block + 1) * block_size);
+        for (size_t i = block * block_size; i < end; i++)
+            fn(i);
+    });
+}
+
+/**
+ * Smooth a welded mesh with Taubin's lambda/mu filter. Each step moves every vertex towards or away from the
+ * average of its neighbours by a factor of lambda or mu. Steps are Jacobi updates: every vertex is read from one
+ * buffer and written to the other, so vertices are updated in parallel with no ordering between them.
+ *
+ * Neighbours are found through compressed sparse row tables of the triangles around each vertex and of the
+ * vertices around each vertex. Vertices on the border of the mesh, where it meets the edges of the grid, are
+ * held in place so that the border does not pull inwards. Normals are recomputed from the smoothed triangles.
+ *
+ * @param mesh The welded mesh to smooth in place
+ * @param settings The number of iterations and the lambda and mu factors
+ * @return How many vertices were smoothed and how long it took
+ */
+SmoothingResult RD3D::smooth_mesh(MarchingCubesMesh& mesh, const SmoothingSettings& settings) {
+    auto start = std::chrono::steady_clock::now();
+    SmoothingResult result;
+    size_t vertex_count = mesh.vertices.size();
+    result.vertices = vertex_count;
+    if (vertex_count == 0) return result;
+
+    // Triangles around each vertex, counted and then filled in through atomic cursors
+    std::vector<uint32_t> triangle_offsets(vertex_count + 1, 0);
+    parallel_over(mesh.indices.size(), [&](size_t i) {
+        std::atomic_ref<uint32_t>(triangle_offsets[mesh.indices[i] + 1]).fetch_add(1, std::memory_order_relaxed);
+    });
+    for (size_t v = 0; v < vertex_count; v++)
+        triangle_offsets[v + 1] += triangle_offsets[v];
+
+    std::vector<uint32_t> cursors(triangle_offsets.begin(), triangle_offsets.end() - 1);
+    std::vector<uint32_t> vertex_triangles(mesh.indices.size());
+    parallel_over(mesh.indices.size(), [&](size_t i) {
+        uint32_t slot = std::atomic_ref<uint32_t>(cursors[mesh.indices[i]]).fetch_add(1, std::memory_order_relaxed);
+        vertex_triangles[slot] = i / 3;
+    });
+
+    // Neighbours of each vertex, two per triangle around it. Inside the mesh every neighbour is shared by two of the
+    // vertex's triangles, so a neighbour seen only once marks a border vertex. Triangles and neighbours are sorted
+    // so that the sums below always add up in the same order
+    std::vector<uint32_t> neighbours(2 * mesh.indices.size());
+    std::vector<uint32_t> neighbour_counts(vertex_count);
+    std::vector<uint8_t> pinned(vertex_count, 0);
+    parallel_over(vertex_count, [&](size_t v) {
+        std::sort(&vertex_triangles[triangle_offsets[v]], &vertex_triangles[triangle_offsets[v + 1]]);
+
+        uint32_t* first = &neighbours[2 * triangle_offsets[v]];
+        uint32_t* last = first;
+        for (uint32_t t = triangle_offsets[v]; t < triangle_offsets[v + 1]; t++) {
+            const unsigned int* triangle = &mesh.indices[3 * vertex_triangles[t]];
+            for (int corner = 0; corner < 3; corner++)
+                if (triangle[corner] != v) *last++ = triangle[corner];
+        }
+        std::sort(first, last);
+
+        uint32_t* out = first;
+        for (uint32_t* it = first; it != last;) {
+            uint32_t* run_end = it;
+            while (run_end != last && *run_end == *it) run_end++;
+            if (run_end - it == 1) pinned[v] = 1;
+            *out++ = *it;
+            it = run_end;
+        }
+        neighbour_counts[v] = out - first;
+    });
+
+    std::vector<glm::vec3> positions(vertex_count);
+    std::vector<glm::vec3> smoothed(vertex_count);
+    parallel_over(vertex_count, [&](size_t v) {
+        positions[v] = mesh.vertices[v].pos;
+    });
+
+    for (int iteration = 0; iteration < 2 * settings.iterations; iteration++) {
+        float factor = iteration % 2 == 0 ? settings.lambda : settings.mu;
+        parallel_over(vertex_count, [&](size_t v) {
+            uint32_t count = neighbour_counts[v];
+            if (pinned[v] || count == 0) {
+                smoothed[v] = positions[v];
+                return;
+            }
+
+            const uint32_t* first = &neighbours[2 * triangle_offsets[v]];
+            glm::vec3 sum(0.0f);
+            for (uint32_t i = 0; i < count; i++)
+                sum += positions[first[i]];
+            smoothed[v] = positions[v] + factor * (sum / (float)count - positions[v]);
+        });
+        positions.swap(smoothed);
+    }
+
+    // Area weighted normals from the smoothed triangles around each vertex, pointing the same way as the winding
+    parallel_over(vertex_count, [&](size_t v) {
+        glm::vec3 normal(0.0f);
+        for (uint32_t t = triangle_offsets[v]; t < triangle_offsets[v + 1]; t++) {
+            const unsigned int* triangle = &mesh.indices[3 * vertex_triangles[t]];
+            glm::vec3 a = positions[triangle[0]], b = positions[triangle[1]], c = positions[triangle[2]];
+            normal += glm::cross(b - a, c - a);
+        }
+
+        float length = glm::length(normal);
+        mesh.vertices[v].pos = positions[v];
+        mesh.vertices[v].normal = length > 0.0f ? normal / length : mesh.vertices[v].normal;
+    });
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,29 @@
+#include "MeshStatistics.hpp"
+
+#include <cstdio>
+
+using namespace RD3D;
+
+/**
+ * Write the statistics as a single JSON object, with the triangles of each surface in an array.
+ */
+std::string MeshStatistics::to_json() const {
+    char buffer[1024];
+    int length = std::snprintf(buffer, sizeof(buffer),
+        "{\"step\":%d,\"surface_count\":%d,\"bricks\":%zu,\"remeshed_bricks\":%zu,"
+        "\"active_cells\":%zu,\"vertices\":%zu,\"triangles\":%zu,"
+        "\"vertex_bytes_used\":%zu,\"vertex_bytes_allocated\":%zu,"
+        "\"index_bytes_used\":%zu,\"index_bytes_allocated\":%zu,\"brick_bytes_allocated\":%zu,"
+        "\"extraction_ms\":%.4f,\"generate_ms\":%.4f,\"upload_ms\":%.4f,\"surface_triangles\":[",
+        step, surface_count, bricks, remeshed_bricks, active_cells, vertices, triangles,
+        vertex_bytes_used, vertex_bytes_allocated, index_bytes_used, index_bytes_allocated, brick_bytes_allocated,
+        extraction_ms, generate_ms, upload_ms);
+
+    std::string json(buffer, length);
+    for (size_t i = 0; i < surface_triangles.size(); i++) {
+        if (i > 0) json += ",";
+        json += std::to_string(surface_triangles[i]);
+    }
+    json += "]}";
+    return json;
+}
@@ -0,0 +1,217 @@
+#include "ObjLoader.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+using namespace RD3D;
+
+// Files are split into chunks of about this many bytes, each parsed by one thread
+static constexpr size_t chunk_size = 1 << 20;
+
+/**
+ * Counts of the elements found in one chunk of the file, which become the chunk's
+ * offsets into the output arrays once prefix summed.
+ */
+struct ChunkCounts {
+    size_t positions = 0;
+    size_t texcoords = 0;
+    size_t normals = 0;
+    size_t triangles = 0;
+};
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && is_space(*p)) p++;
+    return p;
+}
+
+static const char* next_line(const char* p, const char* end) {
+    const char* newline = (const char*)memchr(p, '\n', end - p);
+    return newline ? newline + 1 : end;
+}
+
+static const char* parse_float(const char* p, const char* end, float& value) {
+    p = skip_spaces(p, end);
+    if (p < end && *p == '+') p++;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) value = 0.0f;
+    return result.ptr;
+}
+
+static const char* parse_int(const char* p, const char* end, int& value, bool& found) {
+    if (p < end && *p == '+') p++;
+    auto result = std::from_chars(p, end, value);
+    found = result.ec == std::errc();
+    return result.ptr;
+}
+
+/**
+ * Count the number of corners of the face on the line starting at p.
+ */
+static int count_face_corners(const char* p, const char* end) {
+    int corners = 0;
+    while (true) {
+        p = skip_spaces(p, end);
+        if (p >= end || *p == '\n' || *p == '#') return corners;
+        corners++;
+        while (p < end && !is_space(*p) && *p != '\n') p++;
+    }
+}
+
+/**
+ * Resolve a (possibly negative, relative) one based .obj index into a zero based one.
+ */
+static int resolve_index(int index, size_t defined_so_far) {
+    return index < 0 ? (int)defined_so_far + index : index - 1;
+}
+
+/**
+ * Count the elements defined in [begin, end).
+ */
+static ChunkCounts count_chunk(const char* begin, const char* end) {
+    ChunkCounts counts;
+    for (const char* line = begin; line < end; line = next_line(line, end)) {
+        const char* p = skip_spaces(line, end);
+        if (end - p < 2) continue;
+
+        if (p[0] == 'v' && is_space(p[1])) counts.positions++;
+        else if (p[0] == 'v' && p[1] == 't') counts.texcoords++;
+        else if (p[0] == 'v' && p[1] == 'n') counts.normals++;
+        else if (p[0] == 'f' && is_space(p[1])) counts.triangles += std::max(0, count_face_corners(p + 1, end) - 2);
+    }
+    return counts;
+}
+
+/**
+ * Parse the elements defined in [begin, end) into the output arrays, starting at the chunk's offsets.
+ */
+static void parse_chunk(const char* begin, const char* end, ChunkCounts offsets, ObjData& data) {
+    size_t position = offsets.positions;
+    size_t texcoord = offsets.texcoords;
+    size_t normal = offsets.normals;
+    size_t corner = 3 * offsets.triangles;
+
+    for (const char* line = begin; line < end; line = next_line(line, end)) {
+        const char* p = skip_spaces(line, end);
+        if (end - p < 2) continue;
+
+        if (p[0] == 'v' && is_space(p[1])) {
+            glm::vec3& v = data.positions[position++];
+            p = parse_float(p + 1, end, v.x);
+            p = parse_float(p, end, v.y);
+            parse_float(p, end, v.z);
+        } else if (p[0] == 'v' && p[1] == 't') {
+            glm::vec2& vt = data.texcoords[texcoord++];
+            p = parse_float(p + 2, end, vt.x);
+            parse_float(p, end, vt.y);
+        } else if (p[0] == 'v' && p[1] == 'n') {
+            glm::vec3& vn = data.normals[normal++];
+            p = parse_float(p + 2, end, vn.x);
+            p = parse_float(p, end, vn.y);
+            parse_float(p, end, vn.z);
+        } else if (p[0] == 'f' && is_space(p[1])) {
+            p++;
+            ObjIndex first, previous;
+            int corners = 0;
+
+            while (true) {
+                p = skip_spaces(p, end);
+                if (p >= end || *p == '\n' || *p == '#') break;
+
+                // Corners are written as v, v/vt, v//vn, or v/vt/vn
+                ObjIndex index = {-1, -1, -1};
+                int value;
+                bool found;
+                p = parse_int(p, end, value, found);
+                if (found) index.position = resolve_index(value, position);
+                if (p < end && *p == '/') {
+                    p = parse_int(p + 1, end, value, found);
+                    if (found) index.texcoord = resolve_index(value, texcoord);
+                    if (p < end && *p == '/') {
+                        p = parse_int(p + 1, end, value, found);
+                        if (found) index.normal = resolve_index(value, normal);
+                    }
+                }
+                while (p < end && !is_space(*p) && *p != '\n') p++;
+
+                // Triangulate the face as a fan around its first corner
+                if (corners == 0) first = index;
+                else if (corners >= 2) {
+                    data.indices[corner++] = first;
+                    data.indices[corner++] = previous;
+                    data.indices[corner++] = index;
+                }
+                previous = index;
+                corners++;
+            }
+        }
+    }
+}
+
+/**
+ * Load the geometry of a Wavefront .obj file. The file is mapped into memory and split into line aligned chunks
+ * that are parsed in parallel, first to count the elements of each chunk and then, once the counts are prefix
+ * summed into offsets, to parse every chunk straight into its place in the presized output arrays.
+ * 
+ * @param path File path to the .obj file
+ * @param data The loaded geometry
+ * @param error Description of what went wrong if loading failed
+ * @return Whether the file was loaded successfully
+ */
+bool RD3D::load_obj(const std::string& path, ObjData& data, std::string& error) {
+    MappedFile file(path);
+    if (!file.is_open()) {
+        error = "Cannot open file '" + path + "'\n";
+        return false;
+    }
+
+    data = ObjData();
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    if (file.size() == 0) return true;
+
+    std::vector<const char*> chunk_starts;
+    for (const char* p = begin; p < end; p = next_line(std::min(p + chunk_size, end - 1), end))
+        chunk_starts.push_back(p);
+    chunk_starts.push_back(end);
+    int chunk_count = chunk_starts.size() - 1;
+
+    std::vector<ChunkCounts> offsets(chunk_count + 1);
+    ThreadPool::get().parallel_for(0, chunk_count, [&](int chunk) {
+        offsets[chunk + 1] = count_chunk(chunk_starts[chunk], chunk_starts[chunk + 1]);
+    });
+
+    for (int chunk = 1; chunk <= chunk_count; chunk++) {
+        offsets[chunk].positions += offsets[chunk - 1].positions;
+        offsets[chunk].texcoords += offsets[chunk - 1].texcoords;
+        offsets[chunk].normals += offsets[chunk - 1].normals;
+        offsets[chunk].triangles += offsets[chunk - 1].triangles;
+    }
+
+    data.positions.resize(offsets[chunk_count].positions);
+    data.texcoords.resize(offsets[chunk_count].texcoords);
+    data.normals.resize(offsets[chunk_count].normals);
+    data.indices.resize(3 * offsets[chunk_count].triangles);
+
+    ThreadPool::get().parallel_for(0, chunk_count, [&](int chunk) {
+        parse_chunk(chunk_starts[chunk], chunk_starts[chunk + 1], offsets[chunk], data);
+    });
+
+    // Faces must reference defined vertices, while dangling texture coordinates and normals are simply dropped
+    for (auto& index : data.indices) {
+        if (index.position < 0 || index.position >= (int)data.positions.size()) {
+            error = "Face references an undefined vertex in '" + path + "'\n";
+            return false;
+        }
+        if (index.texcoord >= (int)data.texcoords.size()) index.texcoord = -1;
+        if (index.normal >= (int)data.normals.size()) index.normal = -1;
+    }
+
+    return true;
+}
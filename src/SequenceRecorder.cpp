@@ -0,0 +1,381 @@
+#include <imgui/imgui.h>
+
+#include "SequenceRecorder.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using namespace RD3D;
+
+static constexpr char sequence_magic[8] = {'R', 'D', '3', 'D', 'S', 'E', 'Q', '\0'};
+static constexpr char index_magic[4] = {'R', 'I', 'D', 'X'};
+static constexpr uint32_t sequence_version = 1;
+
+// Meshes are extracted in texture coordinates, and are recorded centered on the origin like they are exported
+static constexpr float sequence_offset = 0.5f;
+
+/**
+ * Header at the start of every sequence file. Frames follow it back to back, each a FrameHeader and its payload.
+ */
+struct SequenceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t grid_resolution;
+    uint32_t step;
+    uint32_t interval;
+    float threshold;
+
+    // Size of one step of a quantized vertex movement
+    float quantum;
+};
+
+enum class FrameType : uint32_t {
+    // Followed by float positions[3 * vertex_count], int16 normals[3 * vertex_count] and uint32 indices[index_count]
+    Keyframe = 0,
+
+    // Followed by int16 movements[3 * vertex_count] and int16 normals[3 * vertex_count], with the previous frame's indices.
+    // Each position is the previous frame's decoded position plus float(movement) * quantum, computed in single precision
+    Delta
+};
+
+struct FrameHeader {
+    FrameType type;
+    uint32_t frame;
+    uint64_t time_step;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint64_t payload_bytes;
+};
+
+/**
+ * Trailer at the very end of the file, after the keyframe entries that it points to.
+ */
+struct IndexTrailer {
+    uint64_t index_offset;
+    uint32_t keyframe_count;
+    char magic[4];
+};
+
+SequenceRecorder::~SequenceRecorder() {
+    for (Capture& capture : captures) {
+        glDeleteSync(capture.fence);
+        glDeleteBuffers(1, &capture.pbo);
+    }
+    captures.clear();
+
+    if (!worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+    worker.join();
+}
+
+/**
+ * Start recording to a new file, extracting the first frame at the next update.
+ *
+ * @param path Where to write the sequence
+ * @param grid_resolution The simulation grid's resolution
+ * @param step The number of grid cells spanned by each edge of a Marching Cubes cell
+ * @param channel GL_RED to record a surface of u, or GL_GREEN to record a surface of v
+ * @param threshold The value of the field at the surface
+ * @param interval The number of time steps between frames
+ * @return Whether the file could be opened
+ */
+bool SequenceRecorder::start(const std::string& path, int grid_resolution, int step, GLenum channel, float threshold, int interval) {
+    if (recording || worker.joinable()) return false;
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "[ERROR] Failed to open sequence file '" << path << "'" << std::endl;
+        write_failed = true;
+        return false;
+    }
+
+    this->grid_resolution = grid_resolution;
+    this->step = step;
+    this->channel = channel;
+    this->threshold = threshold;
+    this->interval = std::max(interval, 1);
+    quantum = 1.0f / (grid_resolution * 1024.0f);
+    next_capture = 0;
+
+    file_offset = 0;
+    previous_indices.clear();
+    previous_positions.clear();
+    keyframes.clear();
+    frames_since_keyframe = 0;
+    frames_written = 0;
+    keyframes_written = 0;
+    frames_dropped = 0;
+    bytes_written = 0;
+    write_failed = false;
+
+    SequenceHeader header = {};
+    std::memcpy(header.magic, sequence_magic, sizeof(sequence_magic));
+    header.version = sequence_version;
+    header.grid_resolution = grid_resolution;
+    header.step = step;
+    header.interval = this->interval;
+    header.threshold = threshold;
+    header.quantum = quantum;
+    write(&header, sizeof(header));
+
+    recording = true;
+    stopping = false;
+    finished = false;
+    worker = std::thread(&SequenceRecorder::worker_loop, this);
+    return true;
+}
+
+/**
+ * Stop capturing frames. The frames already captured are still written, after which the file is finished off
+ * with its keyframe index over the following updates.
+ */
+void SequenceRecorder::stop() {
+    recording = false;
+}
+
+/**
+ * Capture a frame when it is due, hand the captures that the GPU has finished copying to the worker,
+ * and finish the recording once it has been stopped and the worker is done. Called once per frame.
+ *
+ * @param grid_resolution The simulation grid's resolution
+ * @param grid_texture OpenGL texture object refering to the 3D grid
+ * @param time_steps The number of time steps simulated since the grid was last cleared
+ */
+void SequenceRecorder::update(int grid_resolution, GLuint grid_texture, unsigned long long time_steps) {
+    if (recording && grid_resolution != this->grid_resolution) {
+        std::cerr << "[ERROR] The grid was resized, so the sequence recording was stopped" << std::endl;
+        stop();
+    }
+
+    // The worker drops every frame after a failed write, so there is no point capturing any more
+    if (recording && write_failed) stop();
+
+    if (recording) {
+        // The simulation was reset
+        if (time_steps + interval < next_capture) next_capture = time_steps;
+
+        if (time_steps >= next_capture) {
+            size_t queued;
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                queued = queue.size();
+            }
+
+            if (captures.size() + queued >= max_pending_frames) frames_dropped++;
+            else capture(grid_texture, time_steps);
+            next_capture = time_steps + interval;
+        }
+    }
+
+    // Captures finish on the GPU in the order they were made
+    size_t field_size = (size_t)this->grid_resolution * this->grid_resolution * this->grid_resolution;
+    while (!captures.empty()) {
+        Capture& capture = captures.front();
+        GLenum status = glClientWaitSync(capture.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED) break;
+        glDeleteSync(capture.fence);
+
+        const float* data = NULL;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo);
+        if (status != GL_WAIT_FAILED) data = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, field_size * sizeof(float), GL_MAP_READ_BIT);
+
+        if (data != NULL) {
+            Frame frame = {capture.time_step, std::vector<float>(data, data + field_size)};
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                queue.push_back(std::move(frame));
+            }
+            queue_changed.notify_one();
+        } else {
+            frames_dropped++;
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteBuffers(1, &capture.pbo);
+        captures.pop_front();
+    }
+
+    if (!recording && captures.empty() && worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stopping = true;
+        }
+        queue_changed.notify_all();
+        if (finished) worker.join();
+    }
+}
+
+bool SequenceRecorder::is_recording() const {
+    return recording;
+}
+
+/**
+ * Check whether captures or the worker are still running, which needs update to be called every frame.
+ */
+bool SequenceRecorder::has_pending_work() const {
+    return !captures.empty() || (!recording && worker.joinable());
+}
+
+/**
+ * Copy the field into a new pixel pack buffer without waiting for the GPU.
+ */
+void SequenceRecorder::capture(GLuint grid_texture, unsigned long long time_step) {
+    Capture capture;
+    capture.time_step = time_step;
+
+    glGenBuffers(1, &capture.pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)grid_resolution * grid_resolution * grid_resolution * sizeof(float), NULL, GL_STREAM_READ);
+    glBindTexture(GL_TEXTURE_3D, grid_texture);
+    glGetTexImage(GL_TEXTURE_3D, 0, channel, GL_FLOAT, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    capture.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    captures.push_back(capture);
+}
+
+/**
+ * Write queued frames until the recording is stopped and the queue has drained, then write the keyframe index.
+ */
+void SequenceRecorder::worker_loop() {
+    while (true) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_changed.wait(lock, [this]() { return !queue.empty() || stopping; });
+            if (queue.empty()) break;
+
+            frame = std::move(queue.front());
+            queue.pop_front();
+        }
+        if (!write_failed) write_frame(frame);
+    }
+
+    IndexTrailer trailer = {};
+    trailer.index_offset = file_offset;
+    trailer.keyframe_count = keyframes.size();
+    std::memcpy(trailer.magic, index_magic, sizeof(index_magic));
+    write(keyframes.data(), keyframes.size() * sizeof(KeyframeEntry));
+    write(&trailer, sizeof(trailer));
+
+    file.close();
+    if (file.fail() && !write_failed) {
+        std::cerr << "[ERROR] Failed to write sequence file" << std::endl;
+        write_failed = true;
+    }
+    finished = true;
+}
+
+/**
+ * Extract the surface of a frame and append it to the file, as movements of the previous frame's vertices when its
+ * triangles are unchanged and every movement fits in 16 bits, or as a keyframe otherwise.
+ */
+void SequenceRecorder::write_frame(const Frame& frame) {
+    MarchingCubesMesh mesh = marching_cubes(frame.field, grid_resolution, threshold, step);
+    size_t vertex_count = mesh.vertices.size();
+
+    constexpr size_t block_size = 1 << 16;
+    int blocks = (vertex_count + block_size - 1) / block_size;
+
+    std::vector<int16_t> normals(3 * vertex_count);
+    ThreadPool::get().parallel_for(0, blocks, [&](int block) {
+        size_t end = std::min(vertex_count, (block + 1) * block_size);
+        for (size_t i = block * block_size; i < end; i++)
+            for (int axis = 0; axis < 3; axis++)
+                normals[3 * i + axis] = (int16_t)std::round(std::clamp(mesh.vertices[i].normal[axis], -1.0f, 1.0f) * 32767.0f);
+    });
+
+    bool delta = frames_since_keyframe + 1 < keyframe_interval && !keyframes.empty()
+        && vertex_count == previous_positions.size() && mesh.indices == previous_indices;
+
+    std::vector<int16_t> movements;
+    if (delta) {
+        movements.resize(3 * vertex_count);
+        std::atomic<bool> fits = true;
+        ThreadPool::get().parallel_for(0, blocks, [&](int block) {
+            size_t end = std::min(vertex_count, (block + 1) * block_size);
+            for (size_t i = block * block_size; i < end; i++) {
+                glm::vec3 movement = (mesh.vertices[i].pos - sequence_offset - previous_positions[i]) / quantum;
+                for (int axis = 0; axis < 3; axis++) {
+                    float rounded = std::round(movement[axis]);
+                    if (std::abs(rounded) > 32767.0f) fits = false;
+                    movements[3 * i + axis] = (int16_t)std::clamp(rounded, -32767.0f, 32767.0f);
+                }
+            }
+        });
+        delta = fits;
+    }
+
+    FrameHeader header = {};
+    header.frame = frames_written;
+    header.time_step = frame.time_step;
+    header.vertex_count = vertex_count;
+    header.index_count = mesh.indices.size();
+
+    if (delta) {
+        // Track the positions as the reader will decode them, so that rounding errors do not build up between keyframes
+        for (size_t i = 0; i < vertex_count; i++)
+            for (int axis = 0; axis < 3; axis++)
+                previous_positions[i][axis] += (float)movements[3 * i + axis] * quantum;
+
+        header.type = FrameType::Delta;
+        header.payload_bytes = movements.size() * sizeof(int16_t) + normals.size() * sizeof(int16_t);
+        write(&header, sizeof(header));
+        write(movements.data(), movements.size() * sizeof(int16_t));
+        write(normals.data(), normals.size() * sizeof(int16_t));
+        frames_since_keyframe++;
+    } else {
+        previous_positions.resize(vertex_count);
+        for (size_t i = 0; i < vertex_count; i++)
+            previous_positions[i] = mesh.vertices[i].pos - sequence_offset;
+        previous_indices = std::move(mesh.indices);
+
+        keyframes.push_back(KeyframeEntry{header.frame, 0, file_offset});
+        header.type = FrameType::Keyframe;
+        header.payload_bytes = previous_positions.size() * sizeof(glm::vec3) + normals.size() * sizeof(int16_t) + previous_indices.size() * sizeof(unsigned int);
+        write(&header, sizeof(header));
+        write(previous_positions.data(), previous_positions.size() * sizeof(glm::vec3));
+        write(normals.data(), normals.size() * sizeof(int16_t));
+        write(previous_indices.data(), previous_indices.size() * sizeof(unsigned int));
+        frames_since_keyframe = 0;
+        keyframes_written++;
+    }
+    frames_written++;
+}
+
+/**
+ * Append to the file, giving up on the recording at the first failed write.
+ */
+void SequenceRecorder::write(const void* data, size_t bytes) {
+    if (write_failed) return;
+
+    file.write((const char*)data, bytes);
+    if (file.fail()) {
+        std::cerr << "[ERROR] Failed to write sequence file" << std::endl;
+        write_failed = true;
+        return;
+    }
+
+    file_offset += bytes;
+    bytes_written = file_offset;
+}
+
+/**
+ * Draw the state of the current or last recording.
+ */
+void SequenceRecorder::draw_gui() {
+    if (write_failed) ImGui::Text("Recording failed: could not write the sequence file");
+    if (frames_written == 0 && !recording && !worker.joinable()) return;
+
+    ImGui::Text("Frames: %d (%d keyframes), %d dropped", frames_written.load(), keyframes_written.load(), frames_dropped.load());
+    ImGui::Text("Written: %.1f MB", bytes_written / (1024.0 * 1024.0));
+    if (!recording && worker.joinable()) ImGui::Text("Finishing...");
+}
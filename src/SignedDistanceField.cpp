@@ -0,0 +1,192 @@
+#include "SignedDistanceField.hpp"
+#include "Geometry.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace RD3D;
+
+// Number of empty cells that surround the mesh on every side of the field
+static constexpr int padding = 2;
+
+// Number of cells around each triangle for which the exact distance is computed before propagation
+static constexpr int exact_band = 1;
+
+/**
+ * Build the signed distance field of a triangle mesh. Exact distances are computed in a narrow band around
+ * every triangle and then propagated to the rest of the field by sweeping the closest triangle along each axis.
+ * The sign is found by counting ray crossings along the x axis. Every stage runs in parallel over planes or rows.
+ * 
+ * @param positions Vertex positions of the mesh in its local space
+ * @param indices Three indices into positions for each triangle of the mesh
+ * @param resolution Number of samples along the longest axis of the mesh's bounding box
+ */
+SignedDistanceField::SignedDistanceField(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, int resolution) {
+    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (auto& p : positions) {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    if (positions.empty()) lo = hi = glm::vec3(0.0f);
+
+    glm::vec3 extent = hi - lo;
+    float longest = std::max(extent.x, std::max(extent.y, extent.z));
+    cell_size = std::max(longest, 1e-6f) / (float)(resolution - 2 * padding - 1);
+    origin = lo - glm::vec3(padding * cell_size);
+    nx = (int)std::ceil(extent.x / cell_size) + 2 * padding + 1;
+    ny = (int)std::ceil(extent.y / cell_size) + 2 * padding + 1;
+    nz = (int)std::ceil(extent.z / cell_size) + 2 * padding + 1;
+
+    distances = std::vector<float>((size_t)nx * ny * nz, FLT_MAX);
+    std::vector<int> closest_triangles((size_t)nx * ny * nz, -1);
+    std::vector<int> intersection_counts((size_t)nx * ny * nz, 0);
+
+    // Triangles in grid coordinates
+    std::vector<glm::vec3> grid_positions(positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
+        grid_positions[i] = (positions[i] - origin) / cell_size;
+
+    // Bucket the triangles by the z-planes they may affect so that every plane can be processed by a single thread
+    int triangle_count = indices.size() / 3;
+    std::vector<std::vector<int>> plane_triangles(nz);
+    for (int t = 0; t < triangle_count; t++) {
+        float z0 = grid_positions[indices[3 * t + 0]].z;
+        float z1 = grid_positions[indices[3 * t + 1]].z;
+        float z2 = grid_positions[indices[3 * t + 2]].z;
+        int k0 = std::clamp((int)std::floor(std::min(z0, std::min(z1, z2))) - exact_band, 0, nz - 1);
+        int k1 = std::clamp((int)std::ceil(std::max(z0, std::max(z1, z2))) + exact_band, 0, nz - 1);
+        for (int k = k0; k <= k1; k++)
+            plane_triangles[k].push_back(t);
+    }
+
+    ThreadPool::get().parallel_for(0, nz, [&](int k) {
+        for (int t : plane_triangles[k]) {
+            glm::vec3 a = grid_positions[indices[3 * t + 0]];
+            glm::vec3 b = grid_positions[indices[3 * t + 1]];
+            glm::vec3 c = grid_positions[indices[3 * t + 2]];
+
+            // Exact distances in a narrow band around the triangle
+            int i0 = std::clamp((int)std::floor(std::min(a.x, std::min(b.x, c.x))) - exact_band, 0, nx - 1);
+            int i1 = std::clamp((int)std::ceil(std::max(a.x, std::max(b.x, c.x))) + exact_band, 0, nx - 1);
+            int j0 = std::clamp((int)std::floor(std::min(a.y, std::min(b.y, c.y))) - exact_band, 0, ny - 1);
+            int j1 = std::clamp((int)std::ceil(std::max(a.y, std::max(b.y, c.y))) + exact_band, 0, ny - 1);
+
+            for (int j = j0; j <= j1; j++) {
+                for (int i = i0; i <= i1; i++) {
+                    size_t idx = index(i, j, k);
+                    float d = point_triangle_distance(glm::vec3(i, j, k), a, b, c) * cell_size;
+                    if (d < distances[idx]) {
+                        distances[idx] = d;
+                        closest_triangles[idx] = t;
+                    }
+                }
+            }
+
+            // Count where the rays along the x axis through this plane's grid points cross the triangle
+            j0 = std::clamp((int)std::ceil(std::min(a.y, std::min(b.y, c.y))), 0, ny - 1);
+            j1 = std::clamp((int)std::floor(std::max(a.y, std::max(b.y, c.y))), 0, ny - 1);
+            for (int j = j0; j <= j1; j++) {
+                double wa, wb, wc;
+                if (point_in_triangle_2d(j, k, a.y, a.z, b.y, b.z, c.y, c.z, wa, wb, wc)) {
+                    double fi = wa * a.x + wb * b.x + wc * c.x;
+                    int crossing = (int)std::ceil(fi);
+                    if (crossing < 0) intersection_counts[index(0, j, k)]++;
+                    else if (crossing < nx) intersection_counts[index(crossing, j, k)]++;
+                }
+            }
+        }
+    });
+
+    propagate(positions, indices, closest_triangles);
+
+    // An odd number of crossings to the left of a grid point means it is inside of the mesh
+    ThreadPool::get().parallel_for(0, ny * nz, [&](int row) {
+        int j = row % ny;
+        int k = row / ny;
+        int total = 0;
+        for (int i = 0; i < nx; i++) {
+            total += intersection_counts[index(i, j, k)];
+            if (total % 2 == 1) distances[index(i, j, k)] = -distances[index(i, j, k)];
+        }
+    });
+}
+
+/**
+ * Sample the field at a point in the mesh's local space with trilinear interpolation.
+ * Points outside of the field are clamped to its bounds and their distance to it is added on.
+ * 
+ * @param p The point to sample the field at
+ */
+float SignedDistanceField::sample(glm::vec3 p) const {
+    glm::vec3 g = (p - origin) / cell_size;
+    glm::vec3 clamped = glm::clamp(g, glm::vec3(0.0f), glm::vec3(nx - 1, ny - 1, nz - 1));
+    float outside = glm::length(g - clamped) * cell_size;
+
+    int i = std::min((int)clamped.x, nx - 2);
+    int j = std::min((int)clamped.y, ny - 2);
+    int k = std::min((int)clamped.z, nz - 2);
+    float fx = clamped.x - i;
+    float fy = clamped.y - j;
+    float fz = clamped.z - k;
+
+    float d00 = glm::mix(distances[index(i, j, k)], distances[index(i + 1, j, k)], fx);
+    float d10 = glm::mix(distances[index(i, j + 1, k)], distances[index(i + 1, j + 1, k)], fx);
+    float d01 = glm::mix(distances[index(i, j, k + 1)], distances[index(i + 1, j, k + 1)], fx);
+    float d11 = glm::mix(distances[index(i, j + 1, k + 1)], distances[index(i + 1, j + 1, k + 1)], fx);
+    float d = glm::mix(glm::mix(d00, d10, fy), glm::mix(d01, d11, fy), fz);
+
+    return d + outside;
+}
+
+/**
+ * Utility function to get the index of a sample in the field.
+ */
+size_t SignedDistanceField::index(int i, int j, int k) const {
+    return i + (size_t)nx * (j + (size_t)ny * k);
+}
+
+/**
+ * Spread the closest triangle of every sample to its neighbors by sweeping forwards and backwards along each axis.
+ * Rows along the swept axis are independent, so every sweep runs in parallel over rows.
+ * 
+ * @param positions Vertex positions of the mesh in its local space
+ * @param indices Three indices into positions for each triangle of the mesh
+ * @param closest_triangles The closest known triangle of every sample, or -1 if none is known yet
+ */
+void SignedDistanceField::propagate(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices, std::vector<int>& closest_triangles) {
+    int dims[3] = {nx, ny, nz};
+    size_t strides[3] = {1, (size_t)nx, (size_t)nx * ny};
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int axis = 0; axis < 3; axis++) {
+            int u_axis = (axis + 1) % 3;
+            int v_axis = (axis + 2) % 3;
+
+            ThreadPool::get().parallel_for(0, dims[u_axis] * dims[v_axis], [&](int row) {
+                int u = row % dims[u_axis];
+                int v = row / dims[u_axis];
+                size_t row_start = u * strides[u_axis] + v * strides[v_axis];
+
+                for (int direction = 0; direction < 2; direction++) {
+                    for (int step = 1; step < dims[axis]; step++) {
+                        int w = direction == 0 ? step : dims[axis] - 1 - step;
+                        int prev = direction == 0 ? w - 1 : w + 1;
+                        size_t idx = row_start + w * strides[axis];
+
+                        int t = closest_triangles[row_start + prev * strides[axis]];
+                        if (t < 0 || t == closest_triangles[idx]) continue;
+
+                        glm::vec3 p = origin + cell_size * glm::vec3(idx % nx, (idx / nx) % ny, idx / ((size_t)nx * ny));
+                        float d = point_triangle_distance(p, positions[indices[3 * t + 0]], positions[indices[3 * t + 1]], positions[indices[3 * t + 2]]);
+                        if (d < distances[idx]) {
+                            distances[idx] = d;
+                            closest_triangles[idx] = t;
+                        }
+                    }
+                }
+            });
+        }
+    }
+}
@@ -2,11 +2,15 @@
 
 #include "simulator.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace RD3D;
 
 Simulator::Simulator() :
     shader("shaders/reaction_diffusion.glsl"),
-    grid(4 * grid_resolution * grid_resolution * grid_resolution, 0.0f)
+    apply_boundary_shader("shaders/apply_boundary.glsl"),
+    boundary_grid(grid_resolution * grid_resolution * grid_resolution, 0.0f)
 {
 	glGenTextures(1, &grid_texture);
 	glBindTexture(GL_TEXTURE_3D, grid_texture);
@@ -15,21 +19,36 @@ Simulator::Simulator() :
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    load_data_to_texture();
+
+	glGenTextures(1, &boundary_texture);
+	glBindTexture(GL_TEXTURE_3D, boundary_texture);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+	glGenBuffers(1, &dirty_bricks_ssbo);
+	init_staging_buffer();
+	allocate_textures();
+	load_boundary_to_texture();
 
 	boundary.simulator = this;
 }
 
 /**
- * Dispatch the compute shader that solves the Gray-Scott Reaction Diffusion PDEs
+ * Dispatch the compute shader that solves the Gray-Scott Reaction Diffusion PDEs. Nothing is dispatched
+ * while the simulation is paused, unless the brush is painting into the grid.
  */
 void Simulator::simulate_time_steps() {
+	if (!is_animating()) return;
+
     shader.bind();
 	set_shader_uniforms();
     for (int i = 0; i < simulation_time_steps_per_frame; i++) {
         glDispatchCompute(grid_resolution, grid_resolution, grid_resolution);
         glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
     }
+	// Painting on a paused grid dispatches the shader without stepping the reaction
+	if (!paused) time_steps += simulation_time_steps_per_frame;
+	grid_version++;
 }
 
 /**
@@ -37,8 +56,10 @@ void Simulator::simulate_time_steps() {
  * of chemical V at each grid cell to 0.
  */
 void Simulator::reset() {
-	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, grid_resolution, grid_resolution, grid_resolution, 0, GL_RGBA, GL_FLOAT, grid.data());
-	glBindImageTexture(0, grid_texture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+	glClearTexImage(grid_texture, 0, GL_RGBA, GL_FLOAT, NULL);
+	apply_boundary(true);
+	time_steps = 0;
+	grid_version++;
 }
 
 /**
@@ -46,9 +67,10 @@ void Simulator::reset() {
  * including boundary values. 
  */
 void Simulator::resize() {
-	grid = std::vector<float>(4 * grid_resolution * grid_resolution * grid_resolution, 0.0f);
-	boundary.clear_boundary();
-    load_data_to_texture();
+	boundary_grid = std::vector<float>(grid_resolution * grid_resolution * grid_resolution, 0.0f);
+	boundary.brick_states.clear();
+	allocate_textures();
+	load_boundary_to_texture();
 }
 
 /**
@@ -79,6 +101,14 @@ void Simulator::toggle_pause() {
 	paused = !paused;
 }
 
+/**
+ * Check whether the grid changes from frame to frame, which is the case while the simulation
+ * is running or the brush is painting into it.
+ */
+bool Simulator::is_animating() const {
+	return !paused || brush_enabled;
+}
+
 /**
  * Draw the GUI section that allows for manipulation of the simulation's parameters.
  */
@@ -116,10 +146,150 @@ void Simulator::set_shader_uniforms() {
 }
 
 /**
- * Utility function to load everything from the grid 3D vector to the 3D texture on the GPU.
+ * Create the persistently mapped pixel buffer through which dirty bricks are staged
+ * on their way to the 3D texture.
+ */
+void Simulator::init_staging_buffer() {
+	GLsizeiptr size = (GLsizeiptr)staging_brick_capacity * brick_size * brick_size * brick_size * sizeof(float);
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &staging_pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_pbo);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+	staging_ptr = (float*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/**
+ * (Re)allocate the storage of the grid and boundary 3D textures. This only happens when the grid resolution
+ * has changed since the last allocation, in which case the grid starts out empty and every brick of the
+ * boundary has to be uploaded again.
  */
-void Simulator::load_data_to_texture() {
+void Simulator::allocate_textures() {
+	if (texture_resolution == grid_resolution) return;
+
 	glBindTexture(GL_TEXTURE_3D, grid_texture);
-	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, grid_resolution, grid_resolution, grid_resolution, 0, GL_RGBA, GL_FLOAT, grid.data());
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, grid_resolution, grid_resolution, grid_resolution, 0, GL_RGBA, GL_FLOAT, NULL);
+	glClearTexImage(grid_texture, 0, GL_RGBA, GL_FLOAT, NULL);
 	glBindImageTexture(0, grid_texture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+	glBindTexture(GL_TEXTURE_3D, boundary_texture);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, grid_resolution, grid_resolution, grid_resolution, 0, GL_RED, GL_FLOAT, NULL);
+
+	texture_resolution = grid_resolution;
+	time_steps = 0;
+	grid_version++;
+	bricks_per_axis = (grid_resolution + brick_size - 1) / brick_size;
+	dirty_bricks = std::vector<GLuint>(bricks_per_axis * bricks_per_axis * bricks_per_axis, 1);
+}
+
+/**
+ * Block until the GPU has finished reading the bricks that were last written to the staging buffer.
+ */
+void Simulator::wait_for_staging_buffer() {
+	if (staging_fence == nullptr) return;
+
+	while (glClientWaitSync(staging_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+	glDeleteSync(staging_fence);
+	staging_fence = nullptr;
+}
+
+/**
+ * Flag the brick containing the given grid cell so that it is uploaded on the next call to load_boundary_to_texture().
+ * 
+ * @param x The x position of the grid cell
+ * @param y The y position of the grid cell
+ * @param z The z position of the grid cell
+ */
+void Simulator::mark_dirty(int x, int y, int z) {
+	int bx = x / brick_size;
+	int by = y / brick_size;
+	int bz = z / brick_size;
+	dirty_bricks[bx + by * bricks_per_axis + bz * bricks_per_axis * bricks_per_axis] = 1;
+}
+
+/**
+ * Flag every brick of the grid for upload.
+ */
+void Simulator::mark_all_dirty() {
+	std::fill(dirty_bricks.begin(), dirty_bricks.end(), 1);
+}
+
+/**
+ * Utility function to load the dirty bricks of the boundary grid to the boundary texture on the GPU and
+ * apply them to the boundary channel of the simulation grid. Bricks are copied into the persistently mapped
+ * staging buffer and uploaded with glTexSubImage3D, so the texture storage itself is only reallocated when
+ * the grid is resized. The chemical concentrations of the running simulation are left untouched.
+ */
+void Simulator::load_boundary_to_texture() {
+	allocate_textures();
+
+	glBindTexture(GL_TEXTURE_3D, boundary_texture);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging_pbo);
+	wait_for_staging_buffer();
+
+	size_t brick_floats = brick_size * brick_size * brick_size;
+	int slot = 0;
+
+	for (int bz = 0; bz < bricks_per_axis; bz++) {
+		for (int by = 0; by < bricks_per_axis; by++) {
+			for (int bx = 0; bx < bricks_per_axis; bx++) {
+				size_t brick = bx + by * bricks_per_axis + bz * bricks_per_axis * bricks_per_axis;
+				if (!dirty_bricks[brick]) continue;
+
+				// Every slot of the staging buffer is in flight, wait for the GPU to consume them before reusing
+				if (slot == staging_brick_capacity) {
+					staging_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+					wait_for_staging_buffer();
+					slot = 0;
+				}
+
+				int x0 = bx * brick_size, y0 = by * brick_size, z0 = bz * brick_size;
+				int w = std::min(brick_size, grid_resolution - x0);
+				int h = std::min(brick_size, grid_resolution - y0);
+				int d = std::min(brick_size, grid_resolution - z0);
+
+				float* dst = staging_ptr + slot * brick_floats;
+				for (int z = 0; z < d; z++) {
+					for (int y = 0; y < h; y++) {
+						size_t src = x0 + (y0 + y) * grid_resolution + (size_t)(z0 + z) * grid_resolution * grid_resolution;
+						std::memcpy(dst + (y + z * h) * w, &boundary_grid[src], w * sizeof(float));
+					}
+				}
+
+				glTexSubImage3D(GL_TEXTURE_3D, 0, x0, y0, z0, w, h, d, GL_RED, GL_FLOAT, (void*)(slot * brick_floats * sizeof(float)));
+				slot++;
+			}
+		}
+	}
+
+	if (slot > 0) staging_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (slot > 0) apply_boundary(false);
+}
+
+/**
+ * Dispatch the compute shader that copies the boundary texture into the boundary channel of the grid texture.
+ * 
+ * @param all_bricks Whether to apply every brick of the grid or only those flagged as dirty
+ */
+void Simulator::apply_boundary(bool all_bricks) {
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, dirty_bricks_ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, dirty_bricks.size() * sizeof(GLuint), dirty_bricks.data(), GL_STREAM_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, dirty_bricks_ssbo);
+	glBindImageTexture(1, boundary_texture, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+
+	apply_boundary_shader.bind();
+	apply_boundary_shader.set_int("grid_resolution", grid_resolution);
+	apply_boundary_shader.set_int("brick_size", brick_size);
+	apply_boundary_shader.set_int("bricks_per_axis", bricks_per_axis);
+	apply_boundary_shader.set_bool("all_bricks", all_bricks);
+
+	int groups = (grid_resolution + 7) / 8;
+	glDispatchCompute(groups, groups, groups);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	std::fill(dirty_bricks.begin(), dirty_bricks.end(), 0);
+	grid_version++;
 }
\ No newline at end of file
@@ -13,12 +13,19 @@ SliceViewer::SliceViewer(int grid_resolution) :
 }
 
 /**
- * Render the slice of the 3D texture to an OpenGL framebuffer.
+ * Render the slice of the 3D texture to an OpenGL framebuffer, unless it already shows the current
+ * state of the grid at the current depth.
  * 
  * @param grid_resolution The simulation grid's resolution
  * @param grid_texture OpenGL texture object refering to the 3D grid
+ * @param grid_version The simulator's count of changes to the grid texture
  */
-void SliceViewer::render(int grid_resolution, GLuint grid_texture) {
+void SliceViewer::render(int grid_resolution, GLuint grid_texture, unsigned long long grid_version) {
+    if (rendered && rendered_version == grid_version && rendered_depth == slice_depth) return;
+    rendered = true;
+    rendered_version = grid_version;
+    rendered_depth = slice_depth;
+
     glBindFramebuffer(GL_FRAMEBUFFER, slice_fbo);
     glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -46,6 +53,7 @@ void SliceViewer::render(int grid_resolution, GLuint grid_texture) {
 void SliceViewer::resize(int grid_resolution) {
 	glBindTexture(GL_TEXTURE_2D, slice_texture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, grid_resolution, grid_resolution, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	rendered = false;
 }
 
 /**
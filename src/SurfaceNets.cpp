@@ -0,0 +1,193 @@
+#include "SurfaceNets.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+using namespace RD3D;
+
+static constexpr uint32_t no_vertex = std::numeric_limits<uint32_t>::max();
+
+/**
+ * Extract the surface of a scalar field on the CPU with Naive Surface Nets. Every cell the surface passes through
+ * gets a single vertex at the average of the points where the surface crosses the cell's edges, and every grid
+ * edge crossing the surface joins the vertices of the four cells around it into a quad. This gives roughly half
+ * the triangles of Marching Cubes, without the thin slivers Marching Cubes makes where the surface passes close
+ * to a corner.
+ *
+ * Work is split in parallel over z-slabs the same way as Marching Cubes, first to number the vertices and count
+ * the quads of every slab and then, once the counts are prefix summed into offsets, to write the vertices and
+ * quads into their ranges of exactly sized arrays. Each quad is split into two triangles along its shorter
+ * diagonal.
+ *
+ * Every sample is treated as the center of a grid cell, so positions are in texture coordinates like the
+ * Marching Cubes Shader's output, and normals point away from the region above the threshold.
+ *
+ * @param field resolution^3 samples of the scalar field, x-major
+ * @param resolution The number of samples along each axis
+ * @param threshold The value of the field at the surface
+ * @param step The number of samples spanned by each edge of a cell, where larger steps give coarser meshes
+ * @return The welded mesh, with three indices per triangle
+ */
+MarchingCubesMesh RD3D::surface_nets(const std::vector<float>& field, int resolution, float threshold, int step) {
+    int points = (resolution - 1) / step + 1;
+    int cells = points - 1;
+    if (cells <= 0) return {};
+
+    auto sample = [&](int x, int y, int z) {
+        return field[x * step + resolution * (y * step + (size_t)resolution * z * step)];
+    };
+    auto inside = [&](int x, int y, int z) {
+        return sample(x, y, z) < threshold;
+    };
+    // A quad is made for an edge crossing the surface only when all four cells around it are inside the grid
+    auto quad_mask = [&](int x, int y, int z) {
+        bool from = inside(x, y, z);
+        bool interior_x = x >= 1 && x < cells, interior_y = y >= 1 && y < cells, interior_z = z >= 1 && z < cells;
+        int mask = 0;
+        if (x < cells && interior_y && interior_z && inside(x + 1, y, z) != from) mask |= 1;
+        if (y < cells && interior_z && interior_x && inside(x, y + 1, z) != from) mask |= 2;
+        if (z < cells && interior_x && interior_y && inside(x, y, z + 1) != from) mask |= 4;
+        return mask;
+    };
+
+    // Pass 1: number the vertices of each slab's cells, and find and count the quads of each slab's edges
+    std::vector<uint8_t> quad_masks((size_t)points * points * points);
+    std::vector<uint32_t> cell_vertex((size_t)cells * cells * cells, no_vertex);
+    std::vector<size_t> slab_vertices(points + 1, 0);
+    std::vector<size_t> slab_quads(points + 1, 0);
+
+    ThreadPool::get().parallel_for(0, points, [&](int z) {
+        size_t quads = 0;
+        for (int y = 0; y < points; y++) {
+            for (int x = 0; x < points; x++) {
+                int mask = quad_mask(x, y, z);
+                quad_masks[x + points * (y + (size_t)points * z)] = mask;
+                quads += std::popcount((unsigned int)mask);
+            }
+        }
+        slab_quads[z + 1] = quads;
+        if (z == cells) return;
+
+        uint32_t vertices = 0;
+        for (int y = 0; y < cells; y++) {
+            for (int x = 0; x < cells; x++) {
+                int inside_corners = 0;
+                for (int i = 0; i < 8; i++)
+                    inside_corners += inside(x + (i & 1), y + ((i >> 1) & 1), z + (i >> 2));
+
+                if (inside_corners == 0 || inside_corners == 8) continue;
+                cell_vertex[x + cells * (y + (size_t)cells * z)] = vertices++;
+            }
+        }
+        slab_vertices[z + 1] = vertices;
+    });
+
+    for (int z = 0; z < points; z++) {
+        slab_vertices[z + 1] += slab_vertices[z];
+        slab_quads[z + 1] += slab_quads[z];
+    }
+
+    // Pass 2: place the vertex of each cell the surface passes through
+    MarchingCubesMesh mesh;
+    mesh.vertices.resize(slab_vertices[cells]);
+    mesh.indices.resize(6 * slab_quads[points]);
+    float cell_size = 1.0f / resolution;
+
+    auto vertex_index = [&](const glm::ivec3& cell) {
+        return (unsigned int)(slab_vertices[cell.z] + cell_vertex[cell.x + cells * (cell.y + (size_t)cells * cell.z)]);
+    };
+
+    std::vector<glm::vec3> gradients = compute_gradients(field, resolution, step);
+
+    ThreadPool::get().parallel_for(0, cells, [&](int z) {
+        for (int y = 0; y < cells; y++) {
+            for (int x = 0; x < cells; x++) {
+                uint32_t local = cell_vertex[x + cells * (y + (size_t)cells * z)];
+                if (local == no_vertex) continue;
+
+                float values[8];
+                glm::vec3 corner_gradients[8];
+                for (int i = 0; i < 8; i++) {
+                    int cx = x + (i & 1), cy = y + ((i >> 1) & 1), cz = z + (i >> 2);
+                    values[i] = sample(cx, cy, cz);
+                    corner_gradients[i] = gradients[cx + points * (cy + (size_t)points * cz)];
+                }
+
+                // Average the crossings of the cell's 12 edges, each joining two corners that differ in one bit
+                glm::vec3 sum(0.0f);
+                int crossings = 0;
+                for (int i = 0; i < 8; i++) {
+                    for (int bit = 1; bit < 8; bit <<= 1) {
+                        if (i & bit) continue;
+                        int j = i | bit;
+                        if ((values[i] < threshold) == (values[j] < threshold)) continue;
+
+                        float t = (threshold - values[i]) / (values[j] - values[i]);
+                        glm::vec3 a((i & 1), ((i >> 1) & 1), (i >> 2));
+                        glm::vec3 b((j & 1), ((j >> 1) & 1), (j >> 2));
+                        sum += glm::mix(a, b, t);
+                        crossings++;
+                    }
+                }
+                glm::vec3 offset = sum / (float)crossings;
+
+                // Trilinearly interpolate the corner gradients at the vertex
+                glm::vec3 n(0.0f);
+                for (int i = 0; i < 8; i++) {
+                    float wx = (i & 1) ? offset.x : 1.0f - offset.x;
+                    float wy = ((i >> 1) & 1) ? offset.y : 1.0f - offset.y;
+                    float wz = (i >> 2) ? offset.z : 1.0f - offset.z;
+                    n += wx * wy * wz * corner_gradients[i];
+                }
+
+                MarchingCubeVertex& vertex = mesh.vertices[slab_vertices[z] + local];
+                vertex.pos = ((glm::vec3(x, y, z) + offset) * (float)step + 0.5f) * cell_size;
+                float length = glm::length(n);
+                vertex.normal = length > 0.0f ? -n / length : glm::vec3(0.0f);
+            }
+        }
+    });
+
+    // Pass 3: quads join the vertices of neighbouring slabs, so they are written once every vertex is placed
+    ThreadPool::get().parallel_for(0, points, [&](int z) {
+        size_t out = 6 * slab_quads[z];
+        for (int y = 0; y < points; y++) {
+            for (int x = 0; x < points; x++) {
+                int mask = quad_masks[x + points * (y + (size_t)points * z)];
+                for (int axis = 0; axis < 3; axis++) {
+                    if (((mask >> axis) & 1) == 0) continue;
+
+                    // The four cells around the edge, counterclockwise about the axis
+                    int u = (axis + 1) % 3, v = (axis + 2) % 3;
+                    glm::ivec3 c11(x, y, z);
+                    glm::ivec3 c00 = c11, c10 = c11, c01 = c11;
+                    c00[u]--; c00[v]--;
+                    c10[v]--;
+                    c01[u]--;
+                    unsigned int q[4] = {vertex_index(c00), vertex_index(c10), vertex_index(c11), vertex_index(c01)};
+
+                    // Wind the quad so it faces away from the region above the threshold
+                    if (inside(x, y, z)) std::swap(q[1], q[3]);
+
+                    // Split along the shorter diagonal, which avoids the thinner pair of triangles
+                    float d02 = glm::length(mesh.vertices[q[0]].pos - mesh.vertices[q[2]].pos);
+                    float d13 = glm::length(mesh.vertices[q[1]].pos - mesh.vertices[q[3]].pos);
+                    unsigned int* indices = &mesh.indices[out];
+                    if (d02 <= d13) {
+                        indices[0] = q[0]; indices[1] = q[1]; indices[2] = q[2];
+                        indices[3] = q[0]; indices[4] = q[2]; indices[5] = q[3];
+                    } else {
+                        indices[0] = q[0]; indices[1] = q[1]; indices[2] = q[3];
+                        indices[3] = q[1]; indices[4] = q[2]; indices[5] = q[3];
+                    }
+                    out += 6;
+                }
+            }
+        }
+    });
+
+    return mesh;
+}
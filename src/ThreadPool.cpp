@@ -0,0 +1,111 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+using namespace RD3D;
+
+ThreadPool::ThreadPool(int thread_count) {
+    for (int i = 0; i < thread_count; i++)
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        stopping = true;
+    }
+    tasks_available.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+/**
+ * Get the thread pool shared by the application, which has one worker less than
+ * the number of hardware threads since the calling thread also takes part in the work.
+ */
+ThreadPool& ThreadPool::get() {
+    static ThreadPool pool(std::max(1, (int)std::thread::hardware_concurrency() - 1));
+    return pool;
+}
+
+/**
+ * Get the number of threads that take part in a parallel_for, including the calling thread.
+ */
+int ThreadPool::size() const {
+    return workers.size() + 1;
+}
+
+/**
+ * Call fn for every index in [begin, end) across the pool and block until all calls have returned.
+ * Indices are handed out one at a time, so each index should represent a decent chunk of work (a slab, a brick, a row).
+ * The calling thread works through indices as well, which makes nested calls from inside a worker safe.
+ * 
+ * @param begin First index to process
+ * @param end One past the last index to process
+ * @param fn Function to call with each index
+ */
+void ThreadPool::parallel_for(int begin, int end, const std::function<void(int)>& fn) {
+    if (end <= begin) return;
+
+    struct Job {
+        std::atomic<int> next;
+        std::atomic<int> remaining;
+        std::mutex done_mutex;
+        std::condition_variable done;
+    };
+
+    auto job = std::make_shared<Job>();
+    job->next = begin;
+    job->remaining = end - begin;
+
+    // Helpers may start after the job has already been finished by other threads, so they only hold onto the shared state
+    auto work = [job, end, &fn]() {
+        for (int i = job->next++; i < end; i = job->next++) {
+            fn(i);
+            if (--job->remaining == 0) {
+                std::lock_guard<std::mutex> lock(job->done_mutex);
+                job->done.notify_all();
+            }
+        }
+    };
+
+    int helpers = std::min((int)workers.size(), end - begin - 1);
+    for (int i = 0; i < helpers; i++)
+        enqueue(work);
+
+    work();
+
+    std::unique_lock<std::mutex> lock(job->done_mutex);
+    job->done.wait(lock, [&job]() { return job->remaining == 0; });
+}
+
+/**
+ * Add a task to the queue and wake up a worker to run it.
+ */
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        tasks.push(std::move(task));
+    }
+    tasks_available.notify_one();
+}
+
+/**
+ * Main loop of every worker thread, which runs tasks until the pool is destroyed.
+ */
+void ThreadPool::worker_loop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(tasks_mutex);
+            tasks_available.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
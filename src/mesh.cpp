@@ -1,5 +1,8 @@
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
+#include "ThreadPool.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 /**
@@ -14,59 +17,25 @@ Mesh::Mesh(std::vector<Vertex> vertices) {
 
 /**
  * Creates a Mesh object using data from the Wavefront .obj file specified via path.
+ * The binary cache next to the file is used instead of parsing it when it is up to date.
  * 
  * @param path File path to the .obj file from which to load the mesh
  */
 Mesh::Mesh(std::string path) {
-    tinyobj::ObjReader reader;
-    tinyobj::ObjReaderConfig reader_config;
+    RD3D::CachedMesh mesh;
+    std::string error;
 
-    if (!reader.ParseFromFile(path, reader_config)) {
-        if (!reader.Error().empty())
-            std::cerr << "[ERROR] TinyObjReader: " << reader.Error();
+    if (!RD3D::load_cached_mesh(path, mesh, error)) {
+        std::cerr << "[ERROR] ObjLoader: " << error;
         exit(1);
     }
 
-    auto& attrib = reader.GetAttrib();
-    auto& shapes = reader.GetShapes();
-    
-    for (int s = 0; s < shapes.size(); s++) {
-        int index_offset = 0;
-        for (int f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-            int fv = shapes[s].mesh.num_face_vertices[f];
-            for (int v = 0; v < fv; v++) {
-                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                tinyobj::real_t vx = attrib.vertices[3 * size_t(idx.vertex_index) + 0];
-                tinyobj::real_t vy = attrib.vertices[3 * size_t(idx.vertex_index) + 1];
-                tinyobj::real_t vz = attrib.vertices[3 * size_t(idx.vertex_index) + 2];
-                tinyobj::real_t nx = 0.0f;
-                tinyobj::real_t ny = 0.0f;
-                tinyobj::real_t nz = 0.0f;
-                tinyobj::real_t tx = 0.0f;
-                tinyobj::real_t ty = 0.0f;
-
-                if (idx.normal_index >= 0) {
-                    nx = attrib.normals[3 * size_t(idx.normal_index) + 0];
-                    ny = attrib.normals[3 * size_t(idx.normal_index) + 1];
-                    nz = attrib.normals[3 * size_t(idx.normal_index) + 2];
-                }
-
-                if (idx.texcoord_index >= 0) {
-                    tx = attrib.texcoords[2 * size_t(idx.texcoord_index) + 0];
-                    ty = attrib.texcoords[2 * size_t(idx.texcoord_index) + 1];
-                }
-
-                Vertex out_vertex = {
-                    glm::vec3((float)vx, (float)vy, (float)vz),
-                    glm::vec2((float)tx, (float)ty),
-                    glm::vec3((float)nx, (float)ny, (float)nz)
-                };
-                vertices.push_back(out_vertex);
-            }
-
-            index_offset += fv;
-        }
-    }
+    vertices.resize(mesh.indices.size());
+    RD3D::ThreadPool::get().parallel_for(0, (mesh.indices.size() + 65535) / 65536, [&](int chunk) {
+        size_t end = std::min(mesh.indices.size(), (size_t)(chunk + 1) * 65536);
+        for (size_t i = (size_t)chunk * 65536; i < end; i++)
+            vertices[i] = mesh.vertices[mesh.indices[i]];
+    });
 
     init_data();
 }
@@ -16,6 +16,11 @@ Sandbox::Sandbox(int window_width, int window_height, bool maximized) {
 }
 
 Sandbox::~Sandbox() {
+	// These release OpenGL objects, so they have to go while the context is still current
+	slice_viewer.reset();
+	mesh_generator.reset();
+	simulator.reset();
+
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
@@ -23,7 +28,8 @@ Sandbox::~Sandbox() {
 }
 
 /**
- * Start the main application loop.
+ * Start the main application loop. Each pass only does work whose inputs have changed, and while nothing
+ * is animating the loop sleeps until the next input event, drawing a few frames after each one so the GUI settles.
  */
 void Sandbox::run() {
 	while (!glfwWindowShouldClose(window)) {
@@ -35,16 +41,18 @@ void Sandbox::run() {
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		simulator->simulate_time_steps();
-        mesh_generator->generate(simulator->grid_resolution, simulator->grid_texture);
+        mesh_generator->generate(simulator->grid_resolution, simulator->grid_texture, simulator->grid_version);
+        mesh_generator->update_export(simulator->grid_resolution, simulator->grid_texture);
+        mesh_generator->record_sequence(simulator->grid_resolution, simulator->grid_texture, simulator->time_steps);
 
         // Draw all the meshes to the screen (Reaction Diffusion Mesh, Boundary Mesh, Grid Cube Mesh)
-        slice_viewer->render(simulator->grid_resolution, simulator->grid_texture);
+        slice_viewer->render(simulator->grid_resolution, simulator->grid_texture, simulator->grid_version);
 		glViewport(0, 0, window_width - ui_sidebar_width, window_height);
 		glEnable(GL_DEPTH_TEST);
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		glDepthMask(GL_TRUE);
-        mesh_generator->draw(camera, simulator->grid_resolution);
+        mesh_generator->draw(camera, simulator->is_animating());
 		glDepthMask(GL_FALSE);
         simulator->boundary.draw_boundary_mesh(camera);
         simulator->boundary.draw_grid_boundary_mesh(camera);
@@ -55,7 +63,16 @@ void Sandbox::run() {
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
 		glfwSwapBuffers(window);
-		glfwPollEvents();
+
+		// Running exports and GPU work the mesh is waiting on are checked on every frame, and a couple more after they finish so the GUI catches up
+		if (mesh_generator->has_pending_work()) wake_frames = 2;
+		if (simulator->is_animating() || wake_frames > 0) {
+			glfwPollEvents();
+			if (wake_frames > 0) wake_frames--;
+		} else {
+			glfwWaitEvents();
+			wake_frames = 2;
+		}
 	}
 }
 
@@ -175,7 +192,7 @@ void Sandbox::draw_gui(){
 	simulator->boundary.draw_gui();
 
 	ImGui::SeparatorText("Mesh Generation");	
-	mesh_generator->draw_gui(simulator->grid_resolution);
+	mesh_generator->draw_gui(simulator->grid_resolution, simulator->grid_texture);
 
 	ImGui::PopStyleColor(2);
 	ImGui::PopStyleVar(3);